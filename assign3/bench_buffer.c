@@ -0,0 +1,256 @@
+#include "storage_mgr.h"
+#include "buffer_mgr.h"
+#include "dberror.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+// Hit ratio, I/O and pins/sec of every replacement strategy under synthetic access
+// patterns, as CSV. Workloads: uniform, zipf (skewed point lookups), loop (repeated
+// scans of a table larger than the pool) and mixed (zipf lookups with a scan running
+// alongside). A share of the pins dirty their page.
+// usage: bench_buffer [-f frames] [-n pins] [-z skew] [-d dirty%] [workload ...]
+
+#define BENCH_FILE "bench_buffer.bin"
+#define BENCH_FILE_FACTOR 4     // file pages per frame for uniform, zipf and mixed
+#define BENCH_SCAN_SHARE 20     // percentage of mixed pins that belong to the scan
+
+typedef enum Workload {
+    WL_UNIFORM = 0,
+    WL_ZIPF = 1,
+    WL_LOOP = 2,
+    WL_MIXED = 3
+} Workload;
+
+static const char *workloadNames[] = {"uniform", "zipf", "loop", "mixed"};
+
+typedef struct BenchConfig {
+    int numFrames;
+    int numPins;
+    double skew;
+    int dirtyPercent;
+} BenchConfig;
+
+// Draws page numbers for one workload
+typedef struct PageStream {
+    Workload workload;
+    int numPages;
+    double *zipfCdf;        // cumulative probability of ranks 0..numPages-1
+    int scanCursor;
+    unsigned int seed;
+} PageStream;
+
+static int parseWorkload (const char *name);
+static int openStream (PageStream *stream, Workload workload, int numPages, double skew);
+static void closeStream (PageStream *stream);
+static PageNumber nextPage (PageStream *stream);
+static int zipfPage (PageStream *stream);
+static void runBench (Workload workload, ReplacementStrategy strategy, const char *strategyName, BenchConfig *config);
+static double elapsedSeconds (struct timespec *start, struct timespec *end);
+
+int
+main (int argc, char **argv)
+{
+    ReplacementStrategy strategies[] = {RS_FIFO, RS_LRU, RS_CLOCK, RS_LFU, RS_LRU_K};
+    const char *names[] = {"FIFO", "LRU", "CLOCK", "LFU", "LRU-K"};
+    int workloads[4];
+    int numWorkloads = 0;
+    BenchConfig config = {256, 200000, 0.99, 10};
+    SM_FileHandle fh;
+    int opt, i, s;
+
+    while ((opt = getopt(argc, argv, "f:n:z:d:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f': config.numFrames = atoi(optarg); break;
+        case 'n': config.numPins = atoi(optarg); break;
+        case 'z': config.skew = atof(optarg); break;
+        case 'd': config.dirtyPercent = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-f frames] [-n pins] [-z skew] [-d dirty%%] [uniform|zipf|loop|mixed ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (config.numFrames < 1 || config.numPins < 1 || config.skew < 0 || config.dirtyPercent < 0 || config.dirtyPercent > 100)
+    {
+        fprintf(stderr, "%s: frames and pins must be positive, skew at least 0, dirty%% at most 100\n", argv[0]);
+        return 1;
+    }
+    for (i = optind; i < argc && numWorkloads < 4; i++)
+    {
+        workloads[numWorkloads] = parseWorkload(argv[i]);
+        if (workloads[numWorkloads] < 0)
+        {
+            fprintf(stderr, "%s: unknown workload %s\n", argv[0], argv[i]);
+            return 1;
+        }
+        numWorkloads++;
+    }
+    if (numWorkloads == 0)
+        for (numWorkloads = 0; numWorkloads < 4; numWorkloads++)
+            workloads[numWorkloads] = numWorkloads;
+
+    CHECK(createPageFile(BENCH_FILE));
+    CHECK(openPageFile(BENCH_FILE, &fh));
+    CHECK(ensureCapacity(config.numFrames * BENCH_FILE_FACTOR, &fh));
+    CHECK(closePageFile(&fh));
+
+    // Strategies without a built-in policy only use free frames: their pins fail once
+    // the pool is full, which the failed column shows
+    printf("workload,strategy,frames,pages,pins,hit_ratio,hits,misses,reads,writes,failed,pins_per_sec\n");
+    for (i = 0; i < numWorkloads; i++)
+        for (s = 0; s < (int) (sizeof(strategies) / sizeof(strategies[0])); s++)
+            runBench(workloads[i], strategies[s], names[s], &config);
+
+    CHECK(destroyPageFile(BENCH_FILE));
+    return 0;
+}
+
+// ************************************************************
+int
+parseWorkload (const char *name)
+{
+    int w;
+
+    for (w = 0; w < 4; w++)
+        if (strcmp(name, workloadNames[w]) == 0)
+            return w;
+    return -1;
+}
+
+int
+openStream (PageStream *stream, Workload workload, int numPages, double skew)
+{
+    double total = 0.0, sum = 0.0;
+    int i;
+
+    stream->workload = workload;
+    stream->numPages = numPages;
+    stream->zipfCdf = NULL;
+    stream->scanCursor = 0;
+    stream->seed = 1234;
+    if (workload != WL_ZIPF && workload != WL_MIXED)
+        return 0;
+
+    // P(rank k) is proportional to 1 / (k + 1)^skew
+    stream->zipfCdf = malloc(numPages * sizeof(double));
+    if (stream->zipfCdf == NULL)
+        return -1;
+    for (i = 0; i < numPages; i++)
+        total += 1.0 / pow(i + 1, skew);
+    for (i = 0; i < numPages; i++)
+    {
+        sum += 1.0 / pow(i + 1, skew) / total;
+        stream->zipfCdf[i] = sum;
+    }
+    stream->zipfCdf[numPages - 1] = 1.0;
+    return 0;
+}
+
+void
+closeStream (PageStream *stream)
+{
+    free(stream->zipfCdf);
+    stream->zipfCdf = NULL;
+}
+
+PageNumber
+nextPage (PageStream *stream)
+{
+    switch (stream->workload)
+    {
+    case WL_UNIFORM:
+        return rand_r(&stream->seed) % stream->numPages;
+    case WL_ZIPF:
+        return zipfPage(stream);
+    case WL_LOOP:
+        stream->scanCursor = (stream->scanCursor + 1) % stream->numPages;
+        return stream->scanCursor;
+    case WL_MIXED:
+    default:
+        if (rand_r(&stream->seed) % 100 < BENCH_SCAN_SHARE)
+        {
+            stream->scanCursor = (stream->scanCursor + 1) % stream->numPages;
+            return stream->scanCursor;
+        }
+        return zipfPage(stream);
+    }
+}
+
+int
+zipfPage (PageStream *stream)
+{
+    // Binary search of a uniform draw in the cumulative distribution. Ranks are spread
+    // over the file so that hot pages are not all neighbours
+    double u = (double) rand_r(&stream->seed) / ((double) RAND_MAX + 1.0);
+    int low = 0, high = stream->numPages - 1;
+
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+        if (stream->zipfCdf[mid] < u)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return (int) (((long long) low * 2654435761LL) % stream->numPages);
+}
+
+void
+runBench (Workload workload, ReplacementStrategy strategy, const char *strategyName, BenchConfig *config)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle h;
+    BM_PoolStats stats;
+    PageStream stream;
+    struct timespec start, end;
+    unsigned int dirtySeed = 42;
+    int numPages, i, failed = 0;
+    long long pins;
+
+    // The loop workload scans one and a half pools' worth of pages over and over
+    numPages = (workload == WL_LOOP) ? config->numFrames + config->numFrames / 2 + 1
+                                     : config->numFrames * BENCH_FILE_FACTOR;
+    if (openStream(&stream, workload, numPages, config->skew) != 0)
+    {
+        fprintf(stderr, "out of memory for %d pages\n", numPages);
+        exit(1);
+    }
+    CHECK(initBufferPool(bm, BENCH_FILE, config->numFrames, strategy, NULL));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < config->numPins; i++)
+    {
+        if (pinPage(bm, &h, nextPage(&stream)) != RC_OK)
+        {
+            failed++;
+            continue;
+        }
+        if (rand_r(&dirtySeed) % 100 < config->dirtyPercent)
+            markDirty(bm, &h);
+        unpinPage(bm, &h);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    CHECK(getPoolStats(bm, &stats));
+    pins = stats.hits + stats.misses;
+    printf("%s,%s,%d,%d,%d,%.4f,%lld,%lld,%lld,%lld,%d,%.0f\n", workloadNames[workload], strategyName,
+           config->numFrames, numPages, config->numPins, pins ? (double) stats.hits / pins : 0.0,
+           stats.hits, stats.misses, stats.readIO, stats.writeIO, failed,
+           config->numPins / elapsedSeconds(&start, &end));
+
+    CHECK(shutdownBufferPool(bm));
+    closeStream(&stream);
+    free(bm);
+}
+
+double
+elapsedSeconds (struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
@@ -0,0 +1,114 @@
+#include "storage_mgr.h"
+#include "buffer_mgr.h"
+#include "dberror.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+// Throughput of pinPage/unpinPage on one shared pool as client threads are added.
+// usage: bench_threads [pins per thread]
+
+#define BENCH_FILE "bench_threads.bin"
+#define BENCH_FRAMES 256
+#define BENCH_MAX_THREADS 16
+
+typedef struct BenchArgs {
+    BM_BufferPool *bm;
+    int numPins;
+    int numFilePages;
+    unsigned int seed;
+    int failures;
+} BenchArgs;
+
+static void *benchWorker (void *arg);
+static double runBench (int numThreads, int numPins, int numFilePages);
+static double elapsedSeconds (struct timespec *start, struct timespec *end);
+
+int
+main (int argc, char **argv)
+{
+    int numPins = (argc > 1) ? atoi(argv[1]) : 200000;
+    int threads[] = {1, 2, 4, 8, 16};
+    int workloads[] = {BENCH_FRAMES / 2, BENCH_FRAMES * 4};
+    SM_FileHandle fh;
+    int i, w;
+
+    CHECK(createPageFile(BENCH_FILE));
+    CHECK(openPageFile(BENCH_FILE, &fh));
+    CHECK(ensureCapacity(BENCH_FRAMES * 4, &fh));
+    CHECK(closePageFile(&fh));
+
+    printf("workload,threads,pins_per_sec\n");
+    for (w = 0; w < 2; w++)
+        for (i = 0; i < (int) (sizeof(threads) / sizeof(threads[0])); i++)
+            printf("%s,%d,%.0f\n", (w == 0) ? "resident" : "mixed", threads[i],
+                   runBench(threads[i], numPins, workloads[w]));
+
+    CHECK(destroyPageFile(BENCH_FILE));
+    return 0;
+}
+
+// ************************************************************
+void *
+benchWorker (void *arg)
+{
+    BenchArgs *args = (BenchArgs *) arg;
+    BM_PageHandle h;
+    int i;
+
+    for (i = 0; i < args->numPins; i++)
+    {
+        if (pinPage(args->bm, &h, rand_r(&args->seed) % args->numFilePages) != RC_OK)
+        {
+            args->failures++;
+            continue;
+        }
+        unpinPage(args->bm, &h);
+    }
+    return NULL;
+}
+
+double
+runBench (int numThreads, int numPins, int numFilePages)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    pthread_t tids[BENCH_MAX_THREADS];
+    BenchArgs args[BENCH_MAX_THREADS];
+    struct timespec start, end;
+    int i, failures = 0;
+
+    CHECK(initBufferPool(bm, BENCH_FILE, BENCH_FRAMES, RS_LRU, NULL));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < numThreads; i++)
+    {
+        args[i].bm = bm;
+        args[i].numPins = numPins;
+        args[i].numFilePages = numFilePages;
+        args[i].seed = 1234 + i;
+        args[i].failures = 0;
+        pthread_create(&tids[i], NULL, benchWorker, &args[i]);
+    }
+    for (i = 0; i < numThreads; i++)
+    {
+        pthread_join(tids[i], NULL);
+        failures += args[i].failures;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    CHECK(shutdownBufferPool(bm));
+    free(bm);
+
+    if (failures > 0)
+        fprintf(stderr, "%d pins failed with %d threads\n", failures, numThreads);
+    return (double) numThreads * numPins / elapsedSeconds(&start, &end);
+}
+
+double
+elapsedSeconds (struct timespec *start, struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
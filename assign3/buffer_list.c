@@ -3,18 +3,23 @@
 #include <stdlib.h>
 #include <string.h>
 
-RC insert_bufpool(EntryPointer *entry, void *buffer_pool_ptr, void *buffer_page_handle)
+// Pool numbers handed out so far; atomic, so insertion does not depend on the caller's latch
+static unsigned short next_trace_id = 0;
+
+RC insert_bufpool(EntryPointer *entry, void *buffer_pool_ptr, Buffer_pool_mgmt *pool_mgmt, SM_FileHandle *fileHandle)
 {
-    EntryPointer newptr = (EntryPointer)malloc(sizeof(BufferPool_Entry));
-    if (newptr == NULL) {
+    // Statistics shards are cache line aligned
+    EntryPointer newptr;
+    if (posix_memalign((void **)&newptr, __alignof__(BufferPool_Entry), sizeof(BufferPool_Entry)) != 0) {
         return RC_INSERT_BUFPOOL_FAILED;  // Memory allocation failed
     }
 
     // Initialize the new buffer pool entry
+    memset(newptr, 0, sizeof(BufferPool_Entry));
     newptr->buffer_pool_ptr = buffer_pool_ptr;
-    newptr->buffer_page_info = buffer_page_handle;
-    newptr->numreadIO = 0;
-    newptr->numwriteIO = 0;
+    newptr->pool_mgmt = pool_mgmt;
+    newptr->fileHandle = fileHandle;
+    newptr->traceId = __atomic_fetch_add(&next_trace_id, 1, __ATOMIC_RELAXED);
     newptr->nextBufferEntry = NULL;
 
     // If the list is empty, insert the new entry at the start
@@ -100,4 +105,27 @@ int getPoolsUsingFile(EntryPointer entry, char *filename)
     }
     return count;  // Return the total count of matching buffer pools
 }
-//-------------------------------------------------------------------------------------------------
\ No newline at end of file
+//-------------------------------------------------------------------------------------------------
+BufferPool_Entry *findPoolByFileName(EntryPointer entry, Buffer_pool_mgmt *pool_mgmt, const char *filename)
+{
+    // Unlike checkPoolsUsingFile the names are compared, so callers may pass any copy of the name
+    for (EntryPointer current = entry; current != NULL; current = current->nextBufferEntry) {
+        BM_BufferPool *bufferpool = (BM_BufferPool *)current->buffer_pool_ptr;
+        if (current->pool_mgmt == pool_mgmt && strcmp(bufferpool->pageFile, filename) == 0) {
+            return current;
+        }
+    }
+    return NULL;
+}
+//-------------------------------------------------------------------------------------------------
+int getPoolsUsingHandle(EntryPointer entry, SM_FileHandle *fileHandle)
+{
+    int count = 0;
+    for (EntryPointer current = entry; current != NULL; current = current->nextBufferEntry) {
+        if (current->fileHandle == fileHandle) {
+            count++;
+        }
+    }
+    return count;
+}
+//-------------------------------------------------------------------------------------------------
@@ -1,36 +1,186 @@
-
 #ifndef BUFFER_LIST_H_INCLUDED
 #define BUFFER_LIST_H_INCLUDED
 
 #include "buffer_mgr.h"
+#include "storage_mgr.h"
+#include "compressed_cache.h"
+#include "frequency_sketch.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include "dt.h"
 
-typedef struct BufferPool_Entry
-{
-    void *buffer_pool_ptr;
-    void *buffer_page_info;
-    int numreadIO;
-    int numwriteIO;
-    struct BufferPool_Entry *nextBufferEntry;
-} BufferPool_Entry, *EntryPointer;
+// Frame arena backing
+#define ARENA_MALLOC   0   // posix_memalign fallback
+#define ARENA_MMAP     1   // anonymous mapping (transparent huge pages advised)
+#define ARENA_HUGETLB  2   // explicit huge page mapping
+
+// Number of independently latched partitions of the page table
+#define BM_NUM_STRIPES 16
+
+// Number of per-thread statistics shards of a pool
+#define BM_STAT_SHARDS 16
 
 typedef struct Buffer_page_info
 {
     char *pageframes;
-    PageNumber pagenums;
-    bool isdirty;
-    int fixcounts;
-    int weight;
-    long double timeStamp;
+    PageNumber pagenums;    // set under the page's stripe latch, atomic for readers without it
+    SM_FileHandle *file;    // file the resident page belongs to; page table key is (file, pagenums), same rules
+    bool isdirty;           // atomic: markDirty sets it with no latch, flushes clear it before copying
+    int fixcounts;          // only changed with atomic operations
+    long long timeStamp;    // last reference, drives the sampling of optimistic reads; atomic
+    int hashNext;           // next frame in the same page table bucket, -1 ends the chain
+    bool ioInProgress;      // page is being read into the frame, pinners wait on the stripe; atomic
+    unsigned int generation; // bumped whenever the frame takes a new page
+    unsigned int version;   // bumped on every pin, load and eviction; validates optimistic reads
+    bool prefetched;        // loaded by prefetch and not pinned since
+    bool transient;         // holds a page the admission filter refused; reused first for the next refused page
+    bool onFreeList;        // unmapped and waiting on the free frame list
+    bool evicting;          // picked for the batch a free list refill is evicting
+    int latch;              // page latch: number of shared holders, or -1 for an exclusive one; atomic
+    int hint;               // BM_PinHint of the page; atomic, see setFrameHint
 } Buffer_page_info;
 
+typedef struct PageTable_Stripe
+{
+    pthread_mutex_t latch;  // protects the stripe's buckets and the fix counts of frames mapped in them
+    pthread_cond_t ioDone;  // broadcast when a read into one of the stripe's frames finishes
+} PageTable_Stripe;
+
+// One contiguous, page-aligned block of frames; a pool grows by adding segments
+typedef struct Frame_segment
+{
+    char *base;
+    size_t size;          // bytes mapped for the segment
+    int kind;             // how the segment was obtained (ARENA_*)
+    int firstFrame;       // index of the segment's first frame
+    int numFrames;
+} Frame_segment;
+
+// Queued prefetch: load pageNum on behalf of entry without pinning it
+typedef struct Prefetch_request
+{
+    struct BufferPool_Entry *entry;
+    PageNumber pageNum;
+} Prefetch_request;
+
+// Frames, page table and latches shared by every pool opened on one page file,
+// or by every pool attached to the global buffer pool
+typedef struct Buffer_pool_mgmt
+{
+    Buffer_page_info *pageInfos;   // dense frame metadata, one entry per frame
+    int numFrames;
+    Frame_segment *segments;       // frame arenas, in frame order
+    int numSegments;
+    pthread_rwlock_t resizeLatch;  // held shared by every operation, exclusively while resizing
+    unsigned long long *dirtyMap;  // one bit per frame, set whenever the frame is dirtied
+    int dirtyWords;                // 64-bit words in dirtyMap
+    int *buckets;                  // page table: first frame of every hash bucket
+    int numBuckets;
+    PageTable_Stripe stripes[BM_NUM_STRIPES];
+    const BM_ReplacementPolicy *policy;  // replacement policy of the frames, NULL if unsupported
+    void *policyState;
+    Compressed_cache *tier;        // compressed copies of evicted clean pages, NULL when off
+    Frequency_sketch *admission;   // access frequencies deciding which misses are cached, NULL when off
+    pthread_mutex_t replLatch;     // serialises victim selection
+    int *freeFrames;               // stack of unmapped, unpinned frames a miss takes first; under replLatch
+    int freeCount;
+    int freeCapacity;
+    pthread_mutex_t waitLatch;     // leaf latch of frameFreed
+    pthread_cond_t frameFreed;     // broadcast when a frame's fix count drops to zero while pins wait
+    int pinWaiters;                // pins sleeping on frameFreed
+    pthread_mutex_t latchWaitLatch; // leaf latch of latchFreed
+    pthread_cond_t latchFreed;     // broadcast when a page latch is released while latches wait
+    int latchWaiters;              // page latches sleeping on latchFreed
+    int keptFrames;                // frames hinted BM_HINT_KEEP
+    int evictSoonFrames;           // frames hinted BM_HINT_EVICT_SOON
+    bool sparingKept;              // findReplace is asking the policy for a victim other than KEEP pages
+    pthread_mutex_t ioLatch;       // the page file handle keeps one seek position
+    int refCount;                  // number of pools sharing this structure
+    int minFrames;                 // the memory governor never takes frames below this
+    long long governorMisses;      // misses of the frames' pools at the last rebalance
+    pthread_t writerThread;        // optional background writer
+    pthread_mutex_t writerLatch;
+    pthread_cond_t writerWake;     // signalled to stop the writer early
+    bool writerRunning;
+    int writerIntervalMs;          // pause between cleaning rounds
+    int writerMaxPages;            // write budget per round
+    int writerLookahead;           // number of upcoming victims inspected per round
+    struct BufferPool_Entry *writerOwner;  // pool whose counters the writer uses
+    pthread_t prefetchThread;      // started by the first prefetch request
+    pthread_mutex_t prefetchLatch;
+    pthread_cond_t prefetchWake;   // new requests queued or worker asked to stop
+    pthread_cond_t prefetchIdle;   // worker finished a request
+    bool prefetchRunning;
+    Prefetch_request *prefetchQueue;  // circular queue of pending requests
+    int prefetchHead;
+    int prefetchCount;
+    int prefetchCapacity;
+    struct BufferPool_Entry *prefetchActive;  // pool whose request is being served
+} Buffer_pool_mgmt;
+
+// Counters of one pool updated by the threads mapped to one shard; each shard
+// has its own cache line so that threads do not contend on the counters
+typedef struct Pool_stats_shard
+{
+    long long hits;
+    long long misses;
+    long long readIO;
+    long long writeIO;
+    long long writeCalls;          // storage writes issued; coalesced runs carry several pages
+    long long pinnedWrites;        // pages pinned by others while their write snapshot was taken
+    long long evictions;           // every victim, written back or not
+    long long evictionWrites;      // victims that had to be written back first
+    long long pins;
+    long long pinLatencyNs;
+    long long prefetchLoads;
+    long long prefetchHits;
+    long long prefetchWasted;
+    long long victimSearches;
+    long long victimRetries;
+    long long ringRecycles;
+    long long optimisticReads;
+    long long optimisticFailures;
+    long long pinWaits;
+    long long pinWaitNs;
+    long long pinWaitTimeouts;
+    long long tierStores;
+    long long tierHits;
+    long long admissionRejects;
+    long long freeRefills;         // batches of victims evicted to refill the free frame list
+    long long latchWaits;
+    long long newPages;
+} __attribute__((aligned(64))) Pool_stats_shard;
+
+// A page file opened by the buffer manager, shared by every pool on it in one frame pool
+typedef struct Pool_file
+{
+    SM_FileHandle handle;          // first, so the SM_FileHandle pointers pools keep point here
+    int nextNewPage;               // next page pinNewPage allocates, unless the file has grown past it; atomic
+} Pool_file;
+
+typedef struct BufferPool_Entry
+{
+    Pool_stats_shard stats[BM_STAT_SHARDS];
+    void *buffer_pool_ptr;
+    Buffer_pool_mgmt *pool_mgmt;
+    SM_FileHandle *fileHandle;     // shared by every pool on the same file and frame pool
+    int pinnedNow;                 // pins held through this pool; the one counter all threads share
+    int pinnedPeak;
+    bool warmRestart;              // shutdownBufferPool saves the resident pages for the next run
+    bool closing;                  // shutdownBufferPool is under way; the governor leaves the pool alone
+    unsigned short traceId;        // pool number in access traces, unique per process
+    int pinWaitMs;                 // how long a pin waits for a free frame, see setPinWait
+    struct BufferPool_Entry *nextBufferEntry;
+} BufferPool_Entry, *EntryPointer;
+
 
-RC insert_bufpool(EntryPointer *entry, void *buffer_pool_ptr, void * buffer_page_dtl);
+RC insert_bufpool(EntryPointer *entry, void *buffer_pool_ptr, Buffer_pool_mgmt *pool_mgmt, SM_FileHandle *fileHandle);
 BufferPool_Entry *find_bufferPool(EntryPointer entryptr, void * buffer_pool_ptr);
 bool delete_bufpool(EntryPointer *entryptr, void *buffer_pool_ptr);
 BufferPool_Entry *checkPoolsUsingFile(EntryPointer entry, int *filename);
 int getPoolsUsingFile(EntryPointer entry, char *filename);
+BufferPool_Entry *findPoolByFileName(EntryPointer entry, Buffer_pool_mgmt *pool_mgmt, const char *filename);
+int getPoolsUsingHandle(EntryPointer entry, SM_FileHandle *fileHandle);
 
 #endif 
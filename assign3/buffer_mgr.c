@@ -2,27 +2,205 @@
 #include "buffer_list.h"
 #include "storage_mgr.h"
 #include "dt.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// Huge page size used to decide whether an arena is worth a MAP_HUGETLB attempt
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// Fix counts and I/O counters are touched outside of any single latch
+#define ATOMIC_LOAD(ptr)        __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(ptr, val)  __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#define ATOMIC_INC(ptr)         __atomic_add_fetch((ptr), 1, __ATOMIC_ACQ_REL)
+#define ATOMIC_DEC(ptr)         __atomic_sub_fetch((ptr), 1, __ATOMIC_ACQ_REL)
+
+// Statistics go to the calling thread's shard of the pool
+#define STAT_ADD(entry, counter, n) __atomic_add_fetch(&(entry)->stats[statShard()].counter, (n), __ATOMIC_RELAXED)
+
+// Dirty bitmap word and bit of a frame
+#define DIRTY_WORD(frame) ((frame) / 64)
+#define DIRTY_BIT(frame)  (1ULL << ((frame) % 64))
+
+// Attempts of readPageOptimistic before it gives up on a page that keeps changing
+#define OPTIMISTIC_READ_RETRIES 3
+
+// First word of a warm restart dump ("BMW1")
+#define WARM_DUMP_MAGIC 0x31574d42
+
+// Longest run of consecutive dirty pages written with one call
+#define WRITE_RUN_MAX 64
+
+// Dirty neighbours cleaned on each side of a dirty victim, in the same write
+#define EVICT_CLEAN_SPAN 8
+
+// Free frame list: a miss refills it when fewer than FREE_LOW_WATER frames are left, by
+// evicting up to FREE_BATCH victims at once. Small pools keep evicting one victim per miss
+#define FREE_BATCH_MAX 32
+#define FREE_LOW_WATER(numFrames) ((numFrames) >= 64 ? (numFrames) / 32 : 1)
+#define FREE_BATCH(numFrames) ((numFrames) < 32 ? 1 : ((numFrames) / 16 < FREE_BATCH_MAX ? (numFrames) / 16 : FREE_BATCH_MAX))
+
+// Outcome of trying to take a frame away from the page it holds
+#define CLAIM_OK      0   // frame is now unmapped and owned by the caller
+#define CLAIM_BUSY    1   // frame is pinned or changed hands, pick another one
+#define CLAIM_FLUSHED 2   // frame was dirty and has been written back, try again
+
+// Memory governor: frames a pool keeps at least, the share of a cold pool's spare frames
+// one rebalance moves, and how many times the misses per frame a pool needs to count as hot
+#define GOVERNOR_MIN_FRAMES 4
+#define GOVERNOR_STEAL_SHARE 4
+#define GOVERNOR_HOT_RATIO 2
 
 static EntryPointer entry_ptr_bp = NULL;
-static long double time_uni = -32674;
-static char *initFrames(const int numPages);
-static Buffer_page_info *findReplace(BM_BufferPool *const bm, BufferPool_Entry *entry_bp);
+static pthread_rwlock_t entry_list_latch = PTHREAD_RWLOCK_INITIALIZER;
+static long long time_uni = 0;
+static int next_stat_shard = 0;
+static __thread int thread_stat_shard = -1;
+static Buffer_pool_mgmt *global_pool = NULL;  // process-wide pool shared by attached page files
+static ReplacementStrategy global_strategy;
+
+// Process-wide frame budget, see setMemoryBudget. Frames are reserved with atomics; the
+// governor latch serialises resizing other pools, and shutdowns take it so that the pools
+// the governor picked stay open. Lock order: governor latch, resize latch, pool list latch
+static pthread_mutex_t governor_latch = PTHREAD_MUTEX_INITIALIZER;
+static long long governor_budget = 0;   // frames all pools may hold together, 0 for no limit
+static long long governor_frames = 0;   // frames all pools hold now
+
+// A pool the governor may resize, with its misses since the last rebalance
+typedef struct Governed_pool
+{
+    BufferPool_Entry *entry;   // one of the pools on the frames, for write-backs while shrinking
+    Buffer_pool_mgmt *mgmt;
+    long long misses;
+    long long totalMisses;
+    double demand;             // misses per frame
+} Governed_pool;
+
+static char *initFrames(const int numPages, size_t *arenaSize, int *arenaKind);
+static void freeFrames(char *arena, size_t arenaSize, int arenaKind);
+static RC createPoolMgmt(const int numPages, ReplacementStrategy strategy, void *stratData, Buffer_pool_mgmt **result);
+static RC sharePool(BM_BufferPool *const bm, const char *const pg_file_name, BufferPool_Entry *existingEntry, ReplacementStrategy strategy);
+static BufferPool_Entry *findCachingEntry(const char *const pg_file_name);
+static void destroyPoolMgmt(Buffer_pool_mgmt *mgmt);
+static void initPoolLatches(Buffer_pool_mgmt *mgmt);
+static void destroyPoolLatches(Buffer_pool_mgmt *mgmt);
+static BufferPool_Entry *findEntry(BM_BufferPool *const bm);
+static int findReplace(Buffer_pool_mgmt *mgmt);
+static int lookupFrame(Buffer_pool_mgmt *mgmt, SM_FileHandle *file, PageNumber pageNum);
+static int handleFrame(BufferPool_Entry *entry_bp, BM_PageHandle *const page);
+static void clearHandle(BM_PageHandle *const page);
+static RC releasePage(BM_BufferPool *const bm, BM_PageHandle *const page, bool dirty);
+static void insertFrame(Buffer_pool_mgmt *mgmt, int frame);
+static void removeFrame(Buffer_pool_mgmt *mgmt, int frame);
+static int claimFrame(BufferPool_Entry *entry_bp, int frame, PageNumber expected);
+static RC getVictimFrame(BM_BufferPool *const bm, BufferPool_Entry *entry_bp, int *frame, bool mayWait, PageNumber newPage);
+static bool admitMiss(Buffer_pool_mgmt *mgmt, SM_FileHandle *file, PageNumber pageNum, int victim);
+static void releaseFrame(Buffer_pool_mgmt *mgmt, int frame);
+static void unfixFrame(Buffer_pool_mgmt *mgmt, int frame);
+static RC flushFrame(BufferPool_Entry *entry_bp, int frame);
+static RC flushUnpinnedFrame(BufferPool_Entry *entry_bp, int frame);
+static long long victimRank(Buffer_pool_mgmt *mgmt, int frame);
+static bool frameEvictable(const void *pool, int frame);
+static int popFreeFrame(Buffer_pool_mgmt *mgmt);
+static int refillFreeFrames(BufferPool_Entry *entry_bp);
+static void rebuildFreeList(Buffer_pool_mgmt *mgmt);
+static RC pinPageLatched(BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber pageNum, BM_LatchMode mode);
+static void latchFrame(BufferPool_Entry *entry_bp, int frame, BM_LatchMode mode);
+static void unlatchFrame(Buffer_pool_mgmt *mgmt, int frame, BM_LatchMode mode);
+static void setFrameHint(Buffer_pool_mgmt *mgmt, int frame, BM_PinHint hint);
+static PageNumber allocatePage(SM_FileHandle *file);
+static int filePages(SM_FileHandle *file);
+static void freeNewPage(SM_FileHandle *file, PageNumber pageNum);
+static RC mapNewPage(BufferPool_Entry *entry_bp, int frame, BM_PageHandle *const page, const PageNumber pageNum, BM_LatchMode mode);
+static RC pinNewPageLatched(BM_BufferPool *const bm, BM_PageHandle *const page, BM_LatchMode mode);
+static RC growForWrite(SM_FileHandle *file, PageNumber endPage);
+static const BM_ReplacementPolicy *builtinPolicy(ReplacementStrategy strategy);
+static void *backgroundWriter(void *arg);
+static void stopWriterThread(Buffer_pool_mgmt *mgmt);
+static void *prefetchWorker(void *arg);
+static void cancelPrefetches(Buffer_pool_mgmt *mgmt, BufferPool_Entry *entry_bp);
+static void stopPrefetchThread(Buffer_pool_mgmt *mgmt);
+static RC pinResident(BufferPool_Entry *entry_bp, BM_PageHandle *const page, const PageNumber pageNum);
+static RC loadPageIntoFrame(BufferPool_Entry *entry_bp, int frame, BM_PageHandle *const page, const PageNumber pageNum, bool prefetch);
+static RC pinPageRingLocked(BM_BufferPool *const bm, BufferPool_Entry *entryBP, BM_PageHandle *const page, const PageNumber pageNum, BM_AccessRing *ring, long long startNs);
+static RC growPool(Buffer_pool_mgmt *mgmt, int newNumFrames);
+static int statShard(void);
+static void setDirty(Buffer_pool_mgmt *mgmt, int frame);
+
+// A dirty frame and the page it holds, sorted by page for writeback
+typedef struct Dirty_page
+{
+    PageNumber pageNum;
+    int frame;
+} Dirty_page;
+
+static int collectDirtyFrames(Buffer_pool_mgmt *mgmt, SM_FileHandle *file, Dirty_page *pages);
+static RC flushDirtyRuns(BufferPool_Entry *entry_bp, const Dirty_page *pages, int count);
+static RC flushAround(BufferPool_Entry *entry_bp, int frame);
+static RC writeWarmDump(BufferPool_Entry *entry_bp);
+static long long nowNs(void);
+static void notePinned(BufferPool_Entry *entry_bp, PageNumber pageNum, long long startNs, bool hit);
+static void traceEvent(BufferPool_Entry *entry_bp, int op, PageNumber pageNum, bool hit);
+static RC shrinkPool(BufferPool_Entry *entry_bp, int newNumFrames);
+static RC rebuildPageTable(Buffer_pool_mgmt *mgmt);
+static RC shutdownPool(BM_BufferPool *const bm);
+static bool reserveFrames(int numFrames);
+static void releaseFrames(int numFrames);
+static int grantFrames(int wanted);
+static int stealFrames(int wanted);
+static RC resizeFrames(BufferPool_Entry *entry_bp, int newNumFrames);
+static int collectGovernedPools(Governed_pool **result);
+
+// Access trace, see startBufferTrace; trace_on is checked without the latch
+static FILE *trace_file = NULL;
+static long long trace_start = 0;
+static bool trace_on = FALSE;
+static pthread_mutex_t trace_latch = PTHREAD_MUTEX_INITIALIZER;
+
+#define TRACE(entry, op, pageNum, hit) \
+    do { \
+        if (ATOMIC_LOAD(&trace_on)) { \
+            traceEvent((entry), (op), (pageNum), (hit)); \
+        } \
+    } while (0)
+
+// Calls a replacement policy hook of the frames' policy, if it has one
+#define POLICY_HOOK(mgmt, hook, ...) \
+    do { \
+        if ((mgmt)->policy != NULL && (mgmt)->policy->hook != NULL) { \
+            (mgmt)->policy->hook((mgmt)->policyState, __VA_ARGS__); \
+        } \
+    } while (0)
+
+// Every operation holds the pool's resize latch shared, resizeBufferPool holds it exclusively
+#define POOL_SHARED(mgmt)     pthread_rwlock_rdlock(&(mgmt)->resizeLatch)
+#define POOL_EXCLUSIVE(mgmt)  pthread_rwlock_wrlock(&(mgmt)->resizeLatch)
+#define POOL_RELEASE(mgmt)    pthread_rwlock_unlock(&(mgmt)->resizeLatch)
+
+// Page table bucket and stripe a (file, page) pair hashes to
+#define BUCKET_OF(mgmt, file, pageNum) \
+    ((int)((((unsigned int)(pageNum) + (unsigned int)((uintptr_t)(file) >> 4)) * 2654435761u) % (unsigned int)(mgmt)->numBuckets))
+#define STRIPE_OF(mgmt, file, pageNum) (&(mgmt)->stripes[BUCKET_OF(mgmt, file, pageNum) % BM_NUM_STRIPES])
 
 RC initBufferPool(BM_BufferPool *const bm, const char *const pg_file_name, const int numPages, ReplacementStrategy strategy, void *stratData)
 {
-    BufferPool_Entry *existingEntry = checkPoolsUsingFile(entry_ptr_bp, pg_file_name);
+    pthread_rwlock_wrlock(&entry_list_latch);
+    BufferPool_Entry *existingEntry = findCachingEntry(pg_file_name);
 
     if (existingEntry != NULL) {
-        bm->pageFile = pg_file_name;
-        bm->numPages = numPages;
-        bm->strategy = strategy;
-        bm->mgmtData = existingEntry->buffer_pool_ptr;  // Ensure buffer_pool_ptr is a valid pointer to BM_BufferPool
-        return insert_bufpool(&entry_ptr_bp, bm, existingEntry->buffer_page_info);
+        RC status = sharePool(bm, pg_file_name, existingEntry, strategy);
+        pthread_rwlock_unlock(&entry_list_latch);
+        return status;
     }
+    pthread_rwlock_unlock(&entry_list_latch);
 
-    SM_FileHandle *fileHandle = malloc(sizeof(SM_FileHandle));
+    SM_FileHandle *fileHandle = calloc(1, sizeof(Pool_file));
     if (!fileHandle) {
         return RC_FILE_HANDLE_NOT_INIT;
     }
@@ -33,476 +211,3421 @@ RC initBufferPool(BM_BufferPool *const bm, const char *const pg_file_name, const
         return status;
     }
 
-    Buffer_page_info *pageInfos = calloc(numPages, sizeof(Buffer_page_info));
-    if (!pageInfos) {
+    // Under a memory budget the pool may get fewer frames than asked
+    int numFrames = grantFrames(numPages);
+    if (numFrames <= 0) {
+        closePageFile(fileHandle);
         free(fileHandle);
-        return RC_MEMORY_ALLOCATION_FAIL;
+        return RC_MEMORY_BUDGET_EXCEEDED;
     }
 
-    for (int i = 0; i < numPages; i++) {
-        pageInfos[i].pageframes = initFrames(numPages);
-        pageInfos[i].fixcounts = 0;
-        pageInfos[i].isdirty = FALSE;
-        pageInfos[i].pagenums = NO_PAGE;
+    Buffer_pool_mgmt *mgmt;
+    status = createPoolMgmt(numFrames, strategy, stratData, &mgmt);
+    if (status != RC_OK) {
+        closePageFile(fileHandle);
+        free(fileHandle);
+        return status;
     }
 
     bm->pageFile = pg_file_name;
-    bm->numPages = numPages;
+    bm->numPages = numFrames;
     bm->strategy = strategy;
     bm->mgmtData = fileHandle;
 
-    return insert_bufpool(&entry_ptr_bp, bm, pageInfos);
+    // The file was opened without the latch: another pool may have started caching it meanwhile
+    pthread_rwlock_wrlock(&entry_list_latch);
+    existingEntry = findCachingEntry(pg_file_name);
+    bool shared = (existingEntry != NULL);
+    if (shared) {
+        status = sharePool(bm, pg_file_name, existingEntry, strategy);
+    } else {
+        status = insert_bufpool(&entry_ptr_bp, bm, mgmt, fileHandle);
+    }
+    pthread_rwlock_unlock(&entry_list_latch);
+    if (shared || status != RC_OK) {
+        destroyPoolMgmt(mgmt);
+        closePageFile(fileHandle);
+        free(fileHandle);
+    }
+    return status;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC sharePool(BM_BufferPool *const bm, const char *const pg_file_name, BufferPool_Entry *existingEntry, ReplacementStrategy strategy)
+{
+    // Another pool already caches this file: share its frames, page table and policy.
+    // A file attached to the global pool stays there, under the global strategy.
+    // Caller holds entry_list_latch exclusively
+    Buffer_pool_mgmt *shared = existingEntry->pool_mgmt;
+    bm->pageFile = pg_file_name;
+    bm->numPages = shared->numFrames;
+    bm->strategy = (shared == global_pool) ? global_strategy : strategy;
+    bm->mgmtData = existingEntry->fileHandle;
+    RC status = insert_bufpool(&entry_ptr_bp, bm, shared, existingEntry->fileHandle);
+    if (status == RC_OK) {
+        shared->refCount++;
+    }
+    return status;
 }
 //--------------------------------------------------------------------------------------------------------------------------------------------------
-static char *initFrames(const int numPages)
+static BufferPool_Entry *findCachingEntry(const char *const pg_file_name)
 {
-    // Allocate and zero-initialize an array of PAGE_SIZE elements, each of size 1 byte.
-    char *frame = (char *)calloc(PAGE_SIZE, sizeof(char));
-    
-    // The calloc function automatically sets the memory to zero,
-    // so there is no need for a manual loop to initialize the memory.
-    
-    return frame;  // Return the allocated and initialized frame.
+    // Attached pools are matched by name, so a file attached under another copy of
+    // its name still lands in the global pool. Caller holds entry_list_latch
+    BufferPool_Entry *entry = checkPoolsUsingFile(entry_ptr_bp, pg_file_name);
+    if (entry == NULL && global_pool != NULL) {
+        entry = findPoolByFileName(entry_ptr_bp, global_pool, pg_file_name);
+    }
+    return entry;
 }
 //--------------------------------------------------------------------------------------------------------------------------------------------------
-RC shutdownBufferPool(BM_BufferPool *const bm)
+static RC createPoolMgmt(const int numPages, ReplacementStrategy strategy, void *stratData, Buffer_pool_mgmt **result)
 {
-    int num_pools;
-    Buffer_page_info *pg_info;
-    BufferPool_Entry *buff_entry;
-    char *frame;
-    bool is_any_page_fixed = FALSE;
+    // The caller reserved numPages frames of the memory budget; they go back with the
+    // structure, or right away when it cannot be built
+    Buffer_pool_mgmt *mgmt = calloc(1, sizeof(Buffer_pool_mgmt));
+    Buffer_page_info *pageInfos = calloc(numPages, sizeof(Buffer_page_info));
 
-    // Check if any page is currently being used (fix count > 0)
-    for (int i = 0; i < bm->numPages; i++) {
-        int fix_count = getFixCounts(bm)[i];
-        if (fix_count > 0) {
-            is_any_page_fixed = TRUE;
-            break;  // Break as soon as a fixed page is found
-        }
+    // Page table with at least two buckets per frame, rounded to a power of two
+    int numBuckets = BM_NUM_STRIPES;
+    while (numBuckets < 2 * numPages) {
+        numBuckets <<= 1;
     }
+    int *buckets = malloc(numBuckets * sizeof(int));
+    Frame_segment *segments = malloc(sizeof(Frame_segment));
+    int dirtyWords = DIRTY_WORD(numPages - 1) + 1;
+    unsigned long long *dirtyMap = calloc(dirtyWords, sizeof(unsigned long long));
+    int *freeFrames = malloc(numPages * sizeof(int));
 
-    // If no pages are fixed, proceed with shutdown
-    if (!is_any_page_fixed) {
-        buff_entry = find_bufferPool(entry_ptr_bp, bm);
-        num_pools = getPoolsUsingFile(entry_ptr_bp, bm->pageFile);
-        pg_info = buff_entry->buffer_page_info;
+    if (!mgmt || !pageInfos || !buckets || !segments || !dirtyMap || !freeFrames) {
+        free(mgmt);
+        free(pageInfos);
+        free(buckets);
+        free(segments);
+        free(dirtyMap);
+        free(freeFrames);
+        releaseFrames(numPages);
+        return RC_MEMORY_ALLOCATION_FAIL;
+    }
 
-        for (int i = 0; i < bm->numPages; i++) {
-            frame = pg_info[i].pageframes;
-            if (pg_info[i].isdirty) {
-                if (writeBlock(pg_info[i].pagenums, bm->mgmtData, frame) != RC_OK) {
-                    return RC_WRITE_FAILED;
-                }
-            }
-            if (num_pools == 1) {
-                free(frame);  // Free memory if this is the last pool using this page
-            }
-        }
+    // All frames live in one page-aligned arena; the page infos above are the dense metadata array
+    size_t arenaSize;
+    int arenaKind;
+    char *arena = initFrames(numPages, &arenaSize, &arenaKind);
+    if (!arena) {
+        free(mgmt);
+        free(pageInfos);
+        free(buckets);
+        free(segments);
+        free(dirtyMap);
+        free(freeFrames);
+        releaseFrames(numPages);
+        return RC_FRAME_INITIALIZATION_FAILED;
+    }
 
-        if (num_pools == 1) {
-            free(pg_info);  // Free the array of page info if this is the last pool
-        }
+    for (int i = 0; i < numPages; i++) {
+        pageInfos[i].pageframes = arena + (size_t)i * PAGE_SIZE;
+        pageInfos[i].fixcounts = 0;
+        pageInfos[i].isdirty = FALSE;
+        pageInfos[i].pagenums = NO_PAGE;
+        pageInfos[i].file = NULL;
+        pageInfos[i].hashNext = -1;
+    }
+    for (int i = 0; i < numBuckets; i++) {
+        buckets[i] = -1;
+    }
 
-        delete_bufpool(&entry_ptr_bp, bm);  // Remove the buffer pool from the pool list
+    mgmt->pageInfos = pageInfos;
+    mgmt->numFrames = numPages;
+    segments[0].base = arena;
+    segments[0].size = arenaSize;
+    segments[0].kind = arenaKind;
+    segments[0].firstFrame = 0;
+    segments[0].numFrames = numPages;
+    mgmt->segments = segments;
+    mgmt->numSegments = 1;
+    mgmt->dirtyMap = dirtyMap;
+    mgmt->dirtyWords = dirtyWords;
+    mgmt->buckets = buckets;
+    mgmt->numBuckets = numBuckets;
+    mgmt->freeFrames = freeFrames;
+    mgmt->freeCapacity = numPages;
+    rebuildFreeList(mgmt);
+    mgmt->refCount = 1;
+    mgmt->minFrames = (numPages < GOVERNOR_MIN_FRAMES) ? numPages : GOVERNOR_MIN_FRAMES;
+    initPoolLatches(mgmt);
 
-        if (num_pools == 1) {
-            closePageFile((SM_FileHandle *) bm->mgmtData);  // Close the file if this is the last pool
-            free(bm->mgmtData);  // Free the management data
+    // stratData, when given, is a policy of the caller's; otherwise strategy picks a built-in one
+    mgmt->policy = (stratData != NULL) ? stratData : builtinPolicy(strategy);
+    if (mgmt->policy != NULL && mgmt->policy->create != NULL) {
+        mgmt->policyState = mgmt->policy->create(numPages, mgmt->policy->config);
+        if (mgmt->policyState == NULL) {
+            mgmt->policy = NULL;
+            destroyPoolMgmt(mgmt);
+            return RC_MEMORY_ALLOCATION_FAIL;
         }
     }
 
+    *result = mgmt;
     return RC_OK;
 }
 //--------------------------------------------------------------------------------------------------------------------------------------------------
-RC forceFlushPool(BM_BufferPool *const bm)
+static void destroyPoolMgmt(Buffer_pool_mgmt *mgmt)
 {
-    BufferPool_Entry *bufEntry = find_bufferPool(entry_ptr_bp, bm);
-    if (bufEntry == NULL) {
-        return RC_BUFFER_POOL_NOT_FOUND;  // Return an error if the buffer pool is not found
+    // Release frames, page table and latches once no pool uses them any more
+    stopPrefetchThread(mgmt);
+    free(mgmt->prefetchQueue);
+    destroyCompressedCache(mgmt->tier);
+    destroyFrequencySketch(mgmt->admission);
+    if (mgmt->policy != NULL && mgmt->policy->destroy != NULL) {
+        mgmt->policy->destroy(mgmt->policyState);
     }
-
-    Buffer_page_info *pageInfo = bufEntry->buffer_page_info;
-
-    for (int i = 0; i < bm->numPages; i++) {
-        char *frame = pageInfo[i].pageframes;
-        
-        if (pageInfo[i].fixcounts == 0 && pageInfo[i].isdirty) {
-            RC status = writeBlock(pageInfo[i].pagenums, bm->mgmtData, frame);
-            if (status != RC_OK) {
-                return RC_WRITE_FAILED;  // Return immediately if writing to disk fails
-            }
-            pageInfo[i].isdirty = FALSE;  // Mark the page as not dirty after writing to disk
-            bufEntry->numwriteIO++;  // Increment the number of write operations
-        }
+    destroyPoolLatches(mgmt);
+    for (int i = 0; i < mgmt->numSegments; i++) {
+        freeFrames(mgmt->segments[i].base, mgmt->segments[i].size, mgmt->segments[i].kind);
     }
-    return RC_OK;
+    free(mgmt->segments);
+    free(mgmt->dirtyMap);
+    free(mgmt->buckets);
+    free(mgmt->freeFrames);
+    free(mgmt->pageInfos);
+    releaseFrames(mgmt->numFrames);
+    free(mgmt);
 }
 //--------------------------------------------------------------------------------------------------------------------------------------------------
-PageNumber *getFrameContents(BM_BufferPool *const bm)
+RC initGlobalBufferPool(const int numPages, ReplacementStrategy strategy, void *stratData)
 {
-    EntryPointer bufferEntry = find_bufferPool(entry_ptr_bp, bm);
-    if (bufferEntry == NULL) {
-        return NULL; // Return NULL if the buffer pool entry is not found
+    if (numPages <= 0) {
+        return RC_PAGE_INFO_CREATION_FAILED;
     }
 
-    // Allocate memory for storing page numbers
-    PageNumber *pageNums = (PageNumber *)calloc(bm->numPages, sizeof(PageNumber));
-    if (pageNums == NULL) {
-        return NULL; // Return NULL if memory allocation fails
+    // Frames come out of the memory budget before the pool list latch is taken
+    int numFrames = grantFrames(numPages);
+    if (numFrames <= 0) {
+        return RC_MEMORY_BUDGET_EXCEEDED;
     }
 
-    Buffer_page_info *bufferPgInfo = bufferEntry->buffer_page_info;
-    
-    // Iterate through the buffer pool and collect page numbers
-    for (int i = 0; i < bm->numPages; i++) {
-        pageNums[i] = bufferPgInfo[i].pagenums;
+    pthread_rwlock_wrlock(&entry_list_latch);
+    if (global_pool != NULL) {
+        pthread_rwlock_unlock(&entry_list_latch);
+        releaseFrames(numFrames);
+        return RC_GLOBAL_POOL_IN_USE;
     }
 
-    return pageNums; // Return the array of page numbers
+    // The global pool holds one reference of its own, attached pools add theirs
+    RC status = createPoolMgmt(numFrames, strategy, stratData, &global_pool);
+    if (status == RC_OK) {
+        global_strategy = strategy;
+    }
+    pthread_rwlock_unlock(&entry_list_latch);
+    return status;
 }
 //--------------------------------------------------------------------------------------------------------------------------------------------------
-int *getFixCounts(BM_BufferPool *const bm)
+RC shutdownGlobalBufferPool(void)
 {
-    EntryPointer bufferEntry = find_bufferPool(entry_ptr_bp, bm);
-    if (bufferEntry == NULL || bufferEntry->buffer_page_info == NULL) {
-        return NULL; // Return NULL if the buffer pool entry or page info is not found
+    pthread_rwlock_wrlock(&entry_list_latch);
+    Buffer_pool_mgmt *mgmt = global_pool;
+    if (mgmt == NULL) {
+        pthread_rwlock_unlock(&entry_list_latch);
+        return RC_GLOBAL_POOL_NOT_FOUND;
+    }
+    if (mgmt->refCount > 1) {
+        pthread_rwlock_unlock(&entry_list_latch);
+        return RC_GLOBAL_POOL_IN_USE;  // pools are still attached
     }
+    global_pool = NULL;
+    pthread_rwlock_unlock(&entry_list_latch);
 
-    int *fixCounts = (int *)calloc(bm->numPages, sizeof(int));
-    if (fixCounts == NULL) {
-        return NULL; // Return NULL if memory allocation fails
+    // Detached pools already wrote their pages back and dropped them from the frames
+    destroyPoolMgmt(mgmt);
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC attachBufferPool(BM_BufferPool *const bm, const char *const pg_file_name)
+{
+    pthread_rwlock_wrlock(&entry_list_latch);
+    Buffer_pool_mgmt *mgmt = global_pool;
+    if (mgmt == NULL) {
+        pthread_rwlock_unlock(&entry_list_latch);
+        return RC_GLOBAL_POOL_NOT_FOUND;
     }
 
-    Buffer_page_info *bufferPgInfo = bufferEntry->buffer_page_info;
-    for (int i = 0; i < bm->numPages; i++) {
-        fixCounts[i] = bufferPgInfo[i].fixcounts;
+    // Pools on the same file share one handle, so the page table keys match
+    RC status = RC_OK;
+    BufferPool_Entry *sameFile = findPoolByFileName(entry_ptr_bp, mgmt, pg_file_name);
+    SM_FileHandle *fileHandle = (sameFile != NULL) ? sameFile->fileHandle : NULL;
+    if (fileHandle == NULL) {
+        fileHandle = calloc(1, sizeof(Pool_file));
+        if (fileHandle == NULL) {
+            status = RC_FILE_HANDLE_NOT_INIT;
+        } else if ((status = openPageFile(pg_file_name, fileHandle)) != RC_OK) {
+            free(fileHandle);
+        }
     }
 
-    return fixCounts; // Return the array of fix counts
+    if (status == RC_OK) {
+        bm->pageFile = pg_file_name;
+        bm->numPages = mgmt->numFrames;
+        bm->strategy = global_strategy;
+        bm->mgmtData = fileHandle;
+        status = insert_bufpool(&entry_ptr_bp, bm, mgmt, fileHandle);
+        if (status == RC_OK) {
+            mgmt->refCount++;
+        } else if (sameFile == NULL) {
+            closePageFile(fileHandle);
+            free(fileHandle);
+        }
+    }
+    pthread_rwlock_unlock(&entry_list_latch);
+    return status;
 }
 //--------------------------------------------------------------------------------------------------------------------------------------------------
-bool *getDirtyFlags(BM_BufferPool *const bm)
+bool globalBufferPoolActive(void)
 {
-    EntryPointer bufferEntry = find_bufferPool(entry_ptr_bp, bm);
-    if (bufferEntry == NULL || bufferEntry->buffer_page_info == NULL) {
-        return NULL; // Return NULL if the buffer pool entry or page info is not found
-    }
+    pthread_rwlock_rdlock(&entry_list_latch);
+    bool active = (global_pool != NULL);
+    pthread_rwlock_unlock(&entry_list_latch);
+    return active;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static char *initFrames(const int numPages, size_t *arenaSize, int *arenaKind)
+{
+    size_t size = (size_t)numPages * PAGE_SIZE;
+    char *arena;
 
-    bool *dirtyFlags = (bool *)calloc(bm->numPages, sizeof(bool));
-    if (dirtyFlags == NULL) {
-        return NULL; // Return NULL if memory allocation fails
+    // Large pools first try explicit huge pages, which cut TLB misses when touching many frames
+    if (size >= HUGE_PAGE_SIZE) {
+#ifdef MAP_HUGETLB
+        size_t hugeSize = (size + HUGE_PAGE_SIZE - 1) & ~((size_t)HUGE_PAGE_SIZE - 1);
+        arena = mmap(NULL, hugeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (arena != MAP_FAILED) {
+            *arenaSize = hugeSize;
+            *arenaKind = ARENA_HUGETLB;
+            return arena;
+        }
+#endif
     }
 
-    Buffer_page_info *bufferPgInfo = bufferEntry->buffer_page_info;
-    for (int i = 0; i < bm->numPages; i++) {
-        dirtyFlags[i] = bufferPgInfo[i].isdirty;
+    // Regular anonymous mapping: page aligned and zero filled, with transparent huge pages requested
+    arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena != MAP_FAILED) {
+#ifdef MADV_HUGEPAGE
+        if (size >= HUGE_PAGE_SIZE) {
+            madvise(arena, size, MADV_HUGEPAGE);
+        }
+#endif
+        *arenaSize = size;
+        *arenaKind = ARENA_MMAP;
+        return arena;
     }
 
-    return dirtyFlags; // Return the array of dirty flags
+    // Last resort: page aligned heap memory
+    if (posix_memalign((void **)&arena, PAGE_SIZE, size) != 0) {
+        return NULL;
+    }
+    memset(arena, 0, size);
+    *arenaSize = size;
+    *arenaKind = ARENA_MALLOC;
+    return arena;
 }
 //--------------------------------------------------------------------------------------------------------------------------------------------------
-int getNumReadIO (BM_BufferPool *const bm)
+static void freeFrames(char *arena, size_t arenaSize, int arenaKind)
 {
-    EntryPointer buffer_entry = find_bufferPool(entry_ptr_bp,bm);
-    return buffer_entry->numreadIO;
+    if (arena == NULL) {
+        return;
+    }
+    if (arenaKind == ARENA_MALLOC) {
+        free(arena);
+    } else {
+        munmap(arena, arenaSize);
+    }
 }
 //--------------------------------------------------------------------------------------------------------------------------------------------------
-int getNumWriteIO (BM_BufferPool *const bm)
-{    
-    EntryPointer buffer_entry=find_bufferPool(entry_ptr_bp,bm);
-    return buffer_entry->numwriteIO;
+static void initPoolLatches(Buffer_pool_mgmt *mgmt)
+{
+    for (int i = 0; i < BM_NUM_STRIPES; i++) {
+        pthread_mutex_init(&mgmt->stripes[i].latch, NULL);
+        pthread_cond_init(&mgmt->stripes[i].ioDone, NULL);
+    }
+    pthread_mutex_init(&mgmt->replLatch, NULL);
+    pthread_mutex_init(&mgmt->waitLatch, NULL);
+    pthread_condattr_t waitAttr;
+    pthread_condattr_init(&waitAttr);
+    pthread_condattr_setclock(&waitAttr, CLOCK_MONOTONIC);  // pin timeouts ignore wall clock changes
+    pthread_cond_init(&mgmt->frameFreed, &waitAttr);
+    pthread_condattr_destroy(&waitAttr);
+    pthread_mutex_init(&mgmt->latchWaitLatch, NULL);
+    pthread_cond_init(&mgmt->latchFreed, NULL);
+    pthread_mutex_init(&mgmt->ioLatch, NULL);
+    pthread_mutex_init(&mgmt->writerLatch, NULL);
+    pthread_cond_init(&mgmt->writerWake, NULL);
+    pthread_mutex_init(&mgmt->prefetchLatch, NULL);
+    pthread_cond_init(&mgmt->prefetchWake, NULL);
+    pthread_cond_init(&mgmt->prefetchIdle, NULL);
+    pthread_rwlock_init(&mgmt->resizeLatch, NULL);
 }
 //--------------------------------------------------------------------------------------------------------------------------------------------------
-RC markDirty(BM_BufferPool * const bm, BM_PageHandle * const page) 
+static void destroyPoolLatches(Buffer_pool_mgmt *mgmt)
 {
-    BufferPool_Entry *pageEntry = find_bufferPool(entry_ptr_bp, bm);
-    if (pageEntry == NULL || pageEntry->buffer_page_info == NULL) {
-        return RC_BUFFER_POOL_NOT_FOUND;  // Appropriate error if buffer pool entry is not found
+    for (int i = 0; i < BM_NUM_STRIPES; i++) {
+        pthread_mutex_destroy(&mgmt->stripes[i].latch);
+        pthread_cond_destroy(&mgmt->stripes[i].ioDone);
+    }
+    pthread_mutex_destroy(&mgmt->replLatch);
+    pthread_mutex_destroy(&mgmt->waitLatch);
+    pthread_cond_destroy(&mgmt->frameFreed);
+    pthread_mutex_destroy(&mgmt->latchWaitLatch);
+    pthread_cond_destroy(&mgmt->latchFreed);
+    pthread_mutex_destroy(&mgmt->ioLatch);
+    pthread_mutex_destroy(&mgmt->writerLatch);
+    pthread_cond_destroy(&mgmt->writerWake);
+    pthread_mutex_destroy(&mgmt->prefetchLatch);
+    pthread_cond_destroy(&mgmt->prefetchWake);
+    pthread_cond_destroy(&mgmt->prefetchIdle);
+    pthread_rwlock_destroy(&mgmt->resizeLatch);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static BufferPool_Entry *findEntry(BM_BufferPool *const bm)
+{
+    pthread_rwlock_rdlock(&entry_list_latch);
+    BufferPool_Entry *entry_bp = find_bufferPool(entry_ptr_bp, bm);
+    pthread_rwlock_unlock(&entry_list_latch);
+    return entry_bp;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC shutdownBufferPool(BM_BufferPool *const bm)
+{
+    // The governor resizes the pools it picked without the pool list latch. Marking the
+    // pool closing under the governor latch waits for a pass that may have picked it and
+    // keeps later passes away, so the flush and teardown run without the latch
+    BufferPool_Entry *entry = findEntry(bm);
+    if (entry == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;
     }
+    pthread_mutex_lock(&governor_latch);
+    entry->closing = TRUE;
+    pthread_mutex_unlock(&governor_latch);
 
-    Buffer_page_info *bufferPgInfo = pageEntry->buffer_page_info;
+    RC status = shutdownPool(bm);
 
-    // Using a for loop for clarity and to tightly scope the index variable 'i'
-    for (int i = 0; i < bm->numPages; i++) {
-        if (bufferPgInfo[i].pagenums == page->pageNum) {
-            bufferPgInfo[i].isdirty = TRUE;
-            return RC_OK;
-        }
+    // Still open: pages were pinned or could not be written
+    entry = findEntry(bm);
+    if (entry != NULL) {
+        pthread_mutex_lock(&governor_latch);
+        entry->closing = FALSE;
+        pthread_mutex_unlock(&governor_latch);
     }
-
-    return RC_MARK_DIRTY_FAILED;
+    return status;
 }
 //--------------------------------------------------------------------------------------------------------------------------------------------------
-RC forcePage(BM_BufferPool * const bm, BM_PageHandle * const page)
+static RC shutdownPool(BM_BufferPool *const bm)
 {
-    BufferPool_Entry *entryBP = find_bufferPool(entry_ptr_bp, bm);
+    BufferPool_Entry *buff_entry = findEntry(bm);
+    if (buff_entry == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;
+    }
 
-    // Ensure the buffer pool entry is valid
-    if (entryBP == NULL) {
-        return RC_BUFFER_POOL_NOT_FOUND; // Appropriate error if the buffer pool entry is not found
+    Buffer_pool_mgmt *mgmt = buff_entry->pool_mgmt;
+
+    // Background work on behalf of this pool holds short pins, so it stops first
+    if (mgmt->writerOwner == buff_entry) {
+        stopWriterThread(mgmt);
     }
+    cancelPrefetches(mgmt, buff_entry);
 
-    // Ensure management data is available before attempting to write
-    if (bm->mgmtData == NULL) {
-        return RC_FORCE_PAGE_ERROR; // Return error if management data is not initialized
+    SM_FileHandle *fileHandle = buff_entry->fileHandle;
+    POOL_EXCLUSIVE(mgmt);
+    Buffer_page_info *pg_info = mgmt->pageInfos;
+
+    // Check if any page of this file is currently being used (fix count > 0)
+    for (int i = 0; i < mgmt->numFrames; i++) {
+        if (pg_info[i].file == fileHandle && ATOMIC_LOAD(&pg_info[i].fixcounts) > 0) {
+            POOL_RELEASE(mgmt);
+            return RC_OK;  // Pool stays up while pages are still pinned
+        }
     }
 
-    // Attempt to write the block to disk
-    RC status = writeBlock(page->pageNum, bm->mgmtData, page->data);
+    // Write the file's dirty pages back in page order
+    Dirty_page *dirtyPages = malloc(mgmt->numFrames * sizeof(Dirty_page));
+    if (dirtyPages == NULL) {
+        POOL_RELEASE(mgmt);
+        return RC_MEMORY_ALLOCATION_FAIL;
+    }
+    int numDirty = collectDirtyFrames(mgmt, fileHandle, dirtyPages);
+    RC status = flushDirtyRuns(buff_entry, dirtyPages, numDirty);
     if (status != RC_OK) {
-        return status; // Propagate the error from writeBlock
+        for (int i = 0; i < numDirty; i++) {
+            if (ATOMIC_LOAD(&pg_info[dirtyPages[i].frame].isdirty)) {
+                setDirty(mgmt, dirtyPages[i].frame);  // still dirty, keep them listed
+            }
+        }
+        free(dirtyPages);
+        POOL_RELEASE(mgmt);
+        return RC_WRITE_FAILED;
     }
+    free(dirtyPages);
 
-    // Increment the I/O write counter
-    entryBP->numwriteIO++;
-
-    return RC_OK;
-}
-//--------------------------------------------------------------------------------------------------------------------------------------------------
-RC unpinPage(BM_BufferPool * const bm, BM_PageHandle * const page) 
-{
-    BufferPool_Entry *entryBP = find_bufferPool(entry_ptr_bp, bm);
-    if (entryBP == NULL || entryBP->buffer_page_info == NULL) {
-        return RC_BUFFER_POOL_NOT_FOUND; // Return an error if the buffer pool or its page info is not found
+    // A dump that cannot be written only costs the next run a cold start
+    if (buff_entry->warmRestart) {
+        writeWarmDump(buff_entry);
     }
 
-    Buffer_page_info *pageInfo = entryBP->buffer_page_info;
+    pthread_rwlock_wrlock(&entry_list_latch);
+    delete_bufpool(&entry_ptr_bp, bm);  // Remove the buffer pool from the pool list
+    int remaining = --mgmt->refCount;
+    bool lastOnFile = (getPoolsUsingHandle(entry_ptr_bp, fileHandle) == 0);
+    pthread_rwlock_unlock(&entry_list_latch);
 
-    // Use a for loop for better readability and scope management of the loop variable 'i'
-    for (int i = 0; i < bm->numPages; i++) {
-        if (pageInfo[i].pagenums == page->pageNum) {
-            if (pageInfo[i].fixcounts > 0) {
-                pageInfo[i].fixcounts--;
+    if (lastOnFile && remaining > 0) {
+        // Frames shared with other files outlive this one: forget its pages
+        for (int i = 0; i < mgmt->numFrames; i++) {
+            if (pg_info[i].pagenums != NO_PAGE && pg_info[i].file == fileHandle) {
+                removeFrame(mgmt, i);
+                POLICY_HOOK(mgmt, on_evict, i);
+                setFrameHint(mgmt, i, BM_HINT_NORMAL);
+                ATOMIC_STORE(&pg_info[i].pagenums, NO_PAGE);
+                ATOMIC_STORE(&pg_info[i].file, NULL);
+                pg_info[i].version++;
             }
-            return RC_OK;
         }
+        if (mgmt->tier != NULL) {
+            compressedCacheDropFile(mgmt->tier, fileHandle);
+        }
+        rebuildFreeList(mgmt);
+    }
+    POOL_RELEASE(mgmt);
+
+    if (remaining == 0) {
+        // Last pool using the frames: release frames, page table and latches
+        destroyPoolMgmt(mgmt);
+    }
+    if (lastOnFile) {
+        closePageFile(fileHandle);
+        free(fileHandle);
     }
 
-    return RC_UNPIN_FAILED; // Return error if no matching page number is found
+    return RC_OK;
 }
 //--------------------------------------------------------------------------------------------------------------------------------------------------
-RC pinPage(BM_BufferPool * const bm, BM_PageHandle * const page, const PageNumber pageNum) 
+RC forceFlushPool(BM_BufferPool *const bm)
 {
-    BufferPool_Entry *entryBP = find_bufferPool(entry_ptr_bp, bm);
-    if (entryBP == NULL || entryBP->buffer_page_info == NULL) {
-        return RC_BUFFER_POOL_NOT_FOUND;
+    BufferPool_Entry *bufEntry = findEntry(bm);
+    if (bufEntry == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;  // Return an error if the buffer pool is not found
     }
 
-    Buffer_page_info *pageInfo = entryBP->buffer_page_info;
-    Buffer_page_info *repPossible = NULL;
+    Buffer_pool_mgmt *mgmt = bufEntry->pool_mgmt;
+    RC status = RC_OK;
 
-    // First loop to find if the page is already pinned
-    for (int i = 0; i < bm->numPages; i++) {
-        if (pageInfo[i].pagenums == pageNum) {
-            pageInfo[i].timeStamp = time_uni++; // Update the timestamp for LRU
-            pageInfo[i].fixcounts++;
-            page->pageNum = pageNum;
-            page->data = pageInfo[i].pageframes;
-            return RC_OK;
-        }
+    POOL_SHARED(mgmt);
+    Dirty_page *dirtyPages = malloc(mgmt->numFrames * sizeof(Dirty_page));
+    if (dirtyPages == NULL) {
+        POOL_RELEASE(mgmt);
+        return RC_MEMORY_ALLOCATION_FAIL;
     }
 
-    // Second loop to find an empty slot or determine replacement needed
-    for (int i = 0; i < bm->numPages; i++) {
-        if (pageInfo[i].pagenums == NO_PAGE) {
-            repPossible = &pageInfo[i];
-            break;
+    // Only frames in the dirty bitmap are visited, in page order, and runs of
+    // consecutive pages go out as one write
+    int numDirty = collectDirtyFrames(mgmt, bufEntry->fileHandle, dirtyPages);
+    status = flushDirtyRuns(bufEntry, dirtyPages, numDirty);
+    for (int i = 0; i < numDirty; i++) {
+        int frame = dirtyPages[i].frame;
+        if (ATOMIC_LOAD(&mgmt->pageInfos[frame].isdirty)) {
+            setDirty(mgmt, frame);  // pinned, failed or skipped: leave it for the next flush
         }
     }
+    free(dirtyPages);
+    POOL_RELEASE(mgmt);
+    return status;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+PageNumber *getFrameContents(BM_BufferPool *const bm)
+{
+    EntryPointer bufferEntry = findEntry(bm);
+    if (bufferEntry == NULL) {
+        return NULL; // Return NULL if the buffer pool entry is not found
+    }
 
-    if (repPossible != NULL) {
-        // Handle empty slot available
-        page->pageNum = pageNum;
-        page->data = repPossible->pageframes;
+    Buffer_pool_mgmt *mgmt = bufferEntry->pool_mgmt;
+    POOL_SHARED(mgmt);
 
-        RC readStatus = readBlock(pageNum, bm->mgmtData, repPossible->pageframes);
-        if (readStatus != RC_OK) {
-            if (readStatus == RC_READ_NON_EXISTING_PAGE || readStatus == RC_OUT_OF_BOUNDS) {
-                readStatus = appendEmptyBlock(bm->mgmtData);
-            }
-            return readStatus;
+    // Allocate memory for storing page numbers
+    PageNumber *pageNums = (PageNumber *)calloc(bm->numPages, sizeof(PageNumber));
+    if (pageNums != NULL) {
+        // Iterate through the buffer pool and collect page numbers; in the global
+        // pool, frames holding other files' pages look empty to this pool
+        for (int i = 0; i < bm->numPages; i++) {
+            bool own = (ATOMIC_LOAD(&mgmt->pageInfos[i].file) == bufferEntry->fileHandle);
+            pageNums[i] = own ? ATOMIC_LOAD(&mgmt->pageInfos[i].pagenums) : NO_PAGE;
         }
+    }
 
-        entryBP->numreadIO++;
-        repPossible->fixcounts = 1;
-        repPossible->pagenums = pageNum;
-        return RC_OK;
-    } else {
-        // Apply replacement strategy
-        if (bm->strategy == RS_FIFO) 
-            return applyFIFO(bm, page, pageNum);
-        else if (bm->strategy == RS_LRU) 
-            return applyLRU(bm, page, pageNum);
-        else if (bm->strategy == RS_LFU)
-            return applyLFU(bm, page, pageNum);
-        else 
-            return RC_PIN_FAILED; 
-    }
-}
-//--------------------------------------------------------------------------------------------------------------------------------------------------
-RC applyFIFO(BM_BufferPool * const bm, BM_PageHandle * const page, const PageNumber pageNum) 
-{
-    BufferPool_Entry *entry_bp;
-    entry_bp = find_bufferPool(entry_ptr_bp, bm);
-    Buffer_page_info *rep_possible = NULL;
-   
-    rep_possible = findReplace(bm, entry_bp);
-    
-    RC write_ok = RC_OK;
-    RC read_ok = RC_OK;
-    
-    if (rep_possible->isdirty == TRUE) 
-    {
-        write_ok = writeBlock(rep_possible->pagenums, bm->mgmtData, rep_possible->pageframes);
-        rep_possible->isdirty = FALSE;
-        entry_bp->numwriteIO++;
-    }
-    
-    read_ok = readBlock(pageNum, bm->mgmtData, rep_possible->pageframes);
-    if((read_ok == RC_READ_NON_EXISTING_PAGE) || (read_ok == RC_OUT_OF_BOUNDS) || (read_ok == RC_READ_FAILED))
-        read_ok = appendEmptyBlock(bm->mgmtData);
-
-    entry_bp->numreadIO++;
-    page->pageNum  = pageNum;
-    page->data = rep_possible->pageframes;
-    rep_possible->pagenums = pageNum;
-    rep_possible->fixcounts = rep_possible->fixcounts + 1;
-    rep_possible->weight = rep_possible->weight + 1;
-
-    if((read_ok == RC_OK) && (write_ok == RC_OK))
-        return RC_OK;
-    else
-        return RC_FIFO_FAILED;
+    POOL_RELEASE(mgmt);
+
+    return pageNums; // Return the array of page numbers
 }
 //--------------------------------------------------------------------------------------------------------------------------------------------------
-RC applyLRU(BM_BufferPool * const bm, BM_PageHandle * const page, const PageNumber pageNum) 
+int *getFixCounts(BM_BufferPool *const bm)
 {
-    BufferPool_Entry *entryBP = find_bufferPool(entry_ptr_bp, bm);
-    if (entryBP == NULL || entryBP->buffer_page_info == NULL) {
-        return RC_BUFFER_POOL_NOT_FOUND; // Return error if buffer pool or page info is not found
-    }
-
-    Buffer_page_info *repPossible = findReplace(bm, entryBP);
-    if (repPossible == NULL) {
-        return RC_LRU_FAILED; // Return error if no replacement candidate is found
+    EntryPointer bufferEntry = findEntry(bm);
+    if (bufferEntry == NULL) {
+        return NULL; // Return NULL if the buffer pool entry or page info is not found
     }
 
-    RC status = RC_OK;
+    Buffer_pool_mgmt *mgmt = bufferEntry->pool_mgmt;
+    POOL_SHARED(mgmt);
 
-    // Write the page to disk if it is dirty
-    if (repPossible->isdirty) {
-        status = writeBlock(repPossible->pagenums, bm->mgmtData, repPossible->pageframes);
-        if (status != RC_OK) {
-            return status; // Propagate the error from writeBlock
+    int *fixCounts = (int *)calloc(bm->numPages, sizeof(int));
+    if (fixCounts != NULL) {
+        for (int i = 0; i < bm->numPages; i++) {
+            bool own = (ATOMIC_LOAD(&mgmt->pageInfos[i].file) == bufferEntry->fileHandle);
+            fixCounts[i] = own ? ATOMIC_LOAD(&mgmt->pageInfos[i].fixcounts) : 0;
         }
-        repPossible->isdirty = FALSE;
-        entryBP->numwriteIO++;
     }
 
-    // Read the new page into the buffer
-    status = readBlock(pageNum, bm->mgmtData, repPossible->pageframes);
-    if (status != RC_OK) {
-        return status; // Return error if read fails
+    POOL_RELEASE(mgmt);
+
+    return fixCounts; // Return the array of fix counts
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+bool *getDirtyFlags(BM_BufferPool *const bm)
+{
+    EntryPointer bufferEntry = findEntry(bm);
+    if (bufferEntry == NULL) {
+        return NULL; // Return NULL if the buffer pool entry or page info is not found
     }
 
-    // Update management fields
-    entryBP->numreadIO++;
-    repPossible->pagenums = pageNum;
-    repPossible->fixcounts++;
-    repPossible->weight++; // Increment weight assuming it may be used for LFU
-    repPossible->timeStamp = (long double)time_uni++; // Update LRU timestamp
+    Buffer_pool_mgmt *mgmt = bufferEntry->pool_mgmt;
+    POOL_SHARED(mgmt);
 
-    // Set the page handle to return to the client
-    page->pageNum = pageNum;
-    page->data = repPossible->pageframes;
+    bool *dirtyFlags = (bool *)calloc(bm->numPages, sizeof(bool));
+    if (dirtyFlags != NULL) {
+        for (int i = 0; i < bm->numPages; i++) {
+            dirtyFlags[i] = (ATOMIC_LOAD(&mgmt->pageInfos[i].file) == bufferEntry->fileHandle) && ATOMIC_LOAD(&mgmt->pageInfos[i].isdirty);
+        }
+    }
 
-    return RC_OK; // If all operations succeed, return OK
+    POOL_RELEASE(mgmt);
+
+    return dirtyFlags; // Return the array of dirty flags
 }
 //--------------------------------------------------------------------------------------------------------------------------------------------------
-RC applyLFU(BM_BufferPool * const bm, BM_PageHandle * const page, const PageNumber pageNum)
+int getNumReadIO (BM_BufferPool *const bm)
+{
+    EntryPointer buffer_entry = findEntry(bm);
+    long long total = 0;
+    for (int i = 0; i < BM_STAT_SHARDS; i++) {
+        total += __atomic_load_n(&buffer_entry->stats[i].readIO, __ATOMIC_RELAXED);
+    }
+    return (int)total;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+int getNumWriteIO (BM_BufferPool *const bm)
+{
+    EntryPointer buffer_entry = findEntry(bm);
+    long long total = 0;
+    for (int i = 0; i < BM_STAT_SHARDS; i++) {
+        total += __atomic_load_n(&buffer_entry->stats[i].writeIO, __ATOMIC_RELAXED);
+    }
+    return (int)total;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC getPoolStats (BM_BufferPool *const bm, BM_PoolStats *stats)
 {
-    BufferPool_Entry *entryBP = find_bufferPool(entry_ptr_bp, bm);
-    if (entryBP == NULL || entryBP->buffer_page_info == NULL) {
-        return RC_BUFFER_POOL_NOT_FOUND; // Return error if buffer pool or page info is not found
+    EntryPointer entry = findEntry(bm);
+    if (entry == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;
     }
 
-    Buffer_page_info *repPossible = findReplace(bm, entryBP);
-    if (repPossible == NULL) {
-        return RC_LFU_FAILED; // Return error if no replacement candidate is found
+    // Sum the shards; counters keep moving meanwhile, so the snapshot is approximate under load
+    Pool_stats_shard total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < BM_STAT_SHARDS; i++) {
+        Pool_stats_shard *shard = &entry->stats[i];
+        total.hits += __atomic_load_n(&shard->hits, __ATOMIC_RELAXED);
+        total.misses += __atomic_load_n(&shard->misses, __ATOMIC_RELAXED);
+        total.readIO += __atomic_load_n(&shard->readIO, __ATOMIC_RELAXED);
+        total.writeIO += __atomic_load_n(&shard->writeIO, __ATOMIC_RELAXED);
+        total.writeCalls += __atomic_load_n(&shard->writeCalls, __ATOMIC_RELAXED);
+        total.pinnedWrites += __atomic_load_n(&shard->pinnedWrites, __ATOMIC_RELAXED);
+        total.evictions += __atomic_load_n(&shard->evictions, __ATOMIC_RELAXED);
+        total.evictionWrites += __atomic_load_n(&shard->evictionWrites, __ATOMIC_RELAXED);
+        total.pins += __atomic_load_n(&shard->pins, __ATOMIC_RELAXED);
+        total.pinLatencyNs += __atomic_load_n(&shard->pinLatencyNs, __ATOMIC_RELAXED);
+        total.prefetchLoads += __atomic_load_n(&shard->prefetchLoads, __ATOMIC_RELAXED);
+        total.prefetchHits += __atomic_load_n(&shard->prefetchHits, __ATOMIC_RELAXED);
+        total.prefetchWasted += __atomic_load_n(&shard->prefetchWasted, __ATOMIC_RELAXED);
+        total.victimSearches += __atomic_load_n(&shard->victimSearches, __ATOMIC_RELAXED);
+        total.victimRetries += __atomic_load_n(&shard->victimRetries, __ATOMIC_RELAXED);
+        total.ringRecycles += __atomic_load_n(&shard->ringRecycles, __ATOMIC_RELAXED);
+        total.optimisticReads += __atomic_load_n(&shard->optimisticReads, __ATOMIC_RELAXED);
+        total.optimisticFailures += __atomic_load_n(&shard->optimisticFailures, __ATOMIC_RELAXED);
+        total.pinWaits += __atomic_load_n(&shard->pinWaits, __ATOMIC_RELAXED);
+        total.pinWaitNs += __atomic_load_n(&shard->pinWaitNs, __ATOMIC_RELAXED);
+        total.pinWaitTimeouts += __atomic_load_n(&shard->pinWaitTimeouts, __ATOMIC_RELAXED);
+        total.tierStores += __atomic_load_n(&shard->tierStores, __ATOMIC_RELAXED);
+        total.tierHits += __atomic_load_n(&shard->tierHits, __ATOMIC_RELAXED);
+        total.admissionRejects += __atomic_load_n(&shard->admissionRejects, __ATOMIC_RELAXED);
+        total.freeRefills += __atomic_load_n(&shard->freeRefills, __ATOMIC_RELAXED);
+        total.latchWaits += __atomic_load_n(&shard->latchWaits, __ATOMIC_RELAXED);
+        total.newPages += __atomic_load_n(&shard->newPages, __ATOMIC_RELAXED);
     }
 
-    RC writeStatus = RC_OK;
-    if (repPossible->isdirty) {
-        writeStatus = writeBlock(repPossible->pagenums, bm->mgmtData, repPossible->pageframes);
-        if (writeStatus != RC_OK) {
-            return writeStatus; // Propagate the error from writeBlock
-        }
-        repPossible->isdirty = FALSE;
-        entryBP->numwriteIO++;
+    stats->hits = total.hits;
+    stats->misses = total.misses;
+    stats->readIO = total.readIO;
+    stats->writeIO = total.writeIO;
+    stats->writeCalls = total.writeCalls;
+    stats->pinnedWrites = total.pinnedWrites;
+    stats->dirtyEvictions = total.evictionWrites;
+    stats->cleanEvictions = (total.evictions > total.evictionWrites) ? total.evictions - total.evictionWrites : 0;
+    stats->avgPinLatencyNs = (total.pins > 0) ? (double)total.pinLatencyNs / total.pins : 0.0;
+    stats->pinnedNow = ATOMIC_LOAD(&entry->pinnedNow);
+    stats->peakPinned = ATOMIC_LOAD(&entry->pinnedPeak);
+    stats->prefetchLoads = total.prefetchLoads;
+    stats->prefetchHits = total.prefetchHits;
+    stats->prefetchWasted = total.prefetchWasted;
+    stats->victimSearches = total.victimSearches;
+    stats->victimRetries = total.victimRetries;
+    stats->ringRecycles = total.ringRecycles;
+    stats->optimisticReads = total.optimisticReads;
+    stats->optimisticFailures = total.optimisticFailures;
+    stats->pinWaits = total.pinWaits;
+    stats->pinWaitTimeouts = total.pinWaitTimeouts;
+    stats->avgPinWaitNs = (total.pinWaits > 0) ? (double)total.pinWaitNs / total.pinWaits : 0.0;
+    stats->tierStores = total.tierStores;
+    stats->tierHits = total.tierHits;
+    stats->admissionRejects = total.admissionRejects;
+    stats->tierPages = 0;
+    stats->tierBytes = 0;
+    Buffer_pool_mgmt *mgmt = entry->pool_mgmt;
+    stats->freeListRefills = total.freeRefills;
+    stats->latchWaits = total.latchWaits;
+    stats->newPages = total.newPages;
+    POOL_SHARED(mgmt);
+    if (mgmt->tier != NULL) {
+        compressedCacheUsage(mgmt->tier, &stats->tierPages, &stats->tierBytes);
+    }
+    pthread_mutex_lock(&mgmt->replLatch);
+    stats->freeFrames = mgmt->freeCount;
+    pthread_mutex_unlock(&mgmt->replLatch);
+    POOL_RELEASE(mgmt);
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC resetPoolStats (BM_BufferPool *const bm)
+{
+    EntryPointer entry = findEntry(bm);
+    if (entry == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;
     }
 
-    RC readStatus = readBlock(pageNum, bm->mgmtData, repPossible->pageframes);
-    if (readStatus != RC_OK) {
-        if (readStatus == RC_READ_NON_EXISTING_PAGE || readStatus == RC_OUT_OF_BOUNDS) {
-            readStatus = appendEmptyBlock(bm->mgmtData);
-            if (readStatus != RC_OK) {
-                return readStatus; // Handle potential error from appending an empty block
-            }
-        } else {
-            return readStatus; // Propagate other read errors
+    // Starts a new measurement interval, getNumReadIO and getNumWriteIO included;
+    // pins still held stay counted
+    for (int i = 0; i < BM_STAT_SHARDS; i++) {
+        long long *counter = (long long *)&entry->stats[i];
+        for (size_t j = 0; j < sizeof(Pool_stats_shard) / sizeof(long long); j++) {
+            __atomic_store_n(&counter[j], 0, __ATOMIC_RELAXED);
         }
     }
+    ATOMIC_STORE(&entry->pinnedPeak, ATOMIC_LOAD(&entry->pinnedNow));
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int statShard(void)
+{
+    // Threads are dealt out to shards round robin on first use
+    if (thread_stat_shard < 0) {
+        thread_stat_shard = __atomic_fetch_add(&next_stat_shard, 1, __ATOMIC_RELAXED) % BM_STAT_SHARDS;
+    }
+    return thread_stat_shard;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static long long nowNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void notePinned(BufferPool_Entry *entry_bp, PageNumber pageNum, long long startNs, bool hit)
+{
+    TRACE(entry_bp, BM_TRACE_PIN, pageNum, hit);
+    if (hit) {
+        STAT_ADD(entry_bp, hits, 1);
+    } else {
+        STAT_ADD(entry_bp, misses, 1);
+    }
+    STAT_ADD(entry_bp, pins, 1);
+    STAT_ADD(entry_bp, pinLatencyNs, nowNs() - startNs);
 
-    entryBP->numreadIO++;
-    repPossible->pagenums = pageNum;
-    repPossible->fixcounts++;
-    repPossible->weight++; // Increment weight for LFU tracking
-    page->pageNum = pageNum;
-    page->data = repPossible->pageframes;
-
-    return RC_OK; // If all operations succeed, return OK
+    int pinned = ATOMIC_INC(&entry_bp->pinnedNow);
+    int peak = ATOMIC_LOAD(&entry_bp->pinnedPeak);
+    while (pinned > peak
+           && !__atomic_compare_exchange_n(&entry_bp->pinnedPeak, &peak, pinned, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
 }
 //--------------------------------------------------------------------------------------------------------------------------------------------------
-Buffer_page_info *findReplace(BM_BufferPool *const bm, BufferPool_Entry *entry_bp) 
+static void traceEvent(BufferPool_Entry *entry_bp, int op, PageNumber pageNum, bool hit)
 {
-    Buffer_page_info *bf_page_info = entry_bp->buffer_page_info;
-    Buffer_page_info *replace_bf_page_info = NULL;
+    BM_TraceRecord record;
+    memset(&record, 0, sizeof(record));
+    record.pageNum = pageNum;
+    record.pool = entry_bp->traceId;
+    record.op = op;
+    record.hit = hit;
 
-    // Find the first un-fixed page as a potential candidate
-    for (int i = 0; i < bm->numPages; i++) {
-        if (bf_page_info[i].fixcounts == 0) {
-            replace_bf_page_info = &bf_page_info[i];
-            break;
-        }
+    // Records are stamped under the latch so the file stays in time order
+    pthread_mutex_lock(&trace_latch);
+    if (trace_file != NULL) {
+        record.timeNs = nowNs() - trace_start;
+        fwrite(&record, sizeof(record), 1, trace_file);
     }
-
-    // If no un-fixed page found, return NULL
-    if (replace_bf_page_info == NULL) {
-        return NULL;
+    pthread_mutex_unlock(&trace_latch);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC startBufferTrace(const char *traceFile)
+{
+    pthread_mutex_lock(&trace_latch);
+    if (trace_file != NULL) {
+        pthread_mutex_unlock(&trace_latch);
+        return RC_TRACE_IN_USE;
     }
 
-    // Iterate through the buffer to find the most suitable replacement page
-    for (int i = 0; i < bm->numPages; i++) {
-        if (bf_page_info[i].fixcounts == 0) {
-            switch (bm->strategy) {
-                case RS_FIFO:
-                case RS_LFU:
-                    // For FIFO and LFU, select the least frequently used page
-                    if (bf_page_info[i].weight < replace_bf_page_info->weight) {
-                        replace_bf_page_info = &bf_page_info[i];
-                    }
-                    break;
-                case RS_LRU:
-                    // For LRU, select the least recently used page
-                    if (bf_page_info[i].timeStamp < replace_bf_page_info->timeStamp) {
-                        replace_bf_page_info = &bf_page_info[i];
-                    }
-                    break;
-            }
+    FILE *file = fopen(traceFile, "wb");
+    BM_TraceHeader header = {BM_TRACE_MAGIC, BM_TRACE_VERSION};
+    if (file == NULL || fwrite(&header, sizeof(header), 1, file) != 1) {
+        if (file != NULL) {
+            fclose(file);
         }
+        pthread_mutex_unlock(&trace_latch);
+        return RC_FILE_OPEN_FAILED;
     }
 
-    return replace_bf_page_info;
+    trace_file = file;
+    trace_start = nowNs();
+    ATOMIC_STORE(&trace_on, TRUE);
+    pthread_mutex_unlock(&trace_latch);
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC stopBufferTrace(void)
+{
+    pthread_mutex_lock(&trace_latch);
+    FILE *file = trace_file;
+    trace_file = NULL;
+    ATOMIC_STORE(&trace_on, FALSE);
+    pthread_mutex_unlock(&trace_latch);
+
+    if (file == NULL) {
+        return RC_TRACE_NOT_STARTED;
+    }
+    return (fclose(file) == 0) ? RC_OK : RC_WRITE_FAILED;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC markDirty(BM_BufferPool * const bm, BM_PageHandle * const page)
+{
+    BufferPool_Entry *pageEntry = findEntry(bm);
+    if (pageEntry == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;  // Appropriate error if buffer pool entry is not found
+    }
+
+    Buffer_pool_mgmt *mgmt = pageEntry->pool_mgmt;
+    TRACE(pageEntry, BM_TRACE_DIRTY, page->pageNum, FALSE);
+    POOL_SHARED(mgmt);
+
+    // The handle of a pinned page names its frame; only foreign handles need the page table
+    int frame = handleFrame(pageEntry, page);
+    if (frame >= 0) {
+        setDirty(mgmt, frame);
+    } else {
+        PageTable_Stripe *stripe = STRIPE_OF(mgmt, pageEntry->fileHandle, page->pageNum);
+        pthread_mutex_lock(&stripe->latch);
+        frame = lookupFrame(mgmt, pageEntry->fileHandle, page->pageNum);
+        if (frame >= 0) {
+            setDirty(mgmt, frame);
+        }
+        pthread_mutex_unlock(&stripe->latch);
+    }
+    POOL_RELEASE(mgmt);
+
+    return (frame >= 0) ? RC_OK : RC_MARK_DIRTY_FAILED;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC forcePage(BM_BufferPool * const bm, BM_PageHandle * const page)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+
+    // Ensure the buffer pool entry is valid
+    if (entryBP == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND; // Appropriate error if the buffer pool entry is not found
+    }
+
+    Buffer_pool_mgmt *mgmt = entryBP->pool_mgmt;
+
+    // Ensure management data is available before attempting to write
+    if (entryBP->fileHandle == NULL) {
+        return RC_FORCE_PAGE_ERROR; // Return error if management data is not initialized
+    }
+
+    // The frame is clean once its contents reach the disk
+    POOL_SHARED(mgmt);
+    int frame = handleFrame(entryBP, page);
+    if (frame >= 0) {
+        ATOMIC_STORE(&mgmt->pageInfos[frame].isdirty, FALSE);
+    } else {
+        PageTable_Stripe *stripe = STRIPE_OF(mgmt, entryBP->fileHandle, page->pageNum);
+        pthread_mutex_lock(&stripe->latch);
+        frame = lookupFrame(mgmt, entryBP->fileHandle, page->pageNum);
+        if (frame >= 0) {
+            ATOMIC_STORE(&mgmt->pageInfos[frame].isdirty, FALSE);
+        }
+        pthread_mutex_unlock(&stripe->latch);
+    }
+
+    // Attempt to write the block to disk
+    pthread_mutex_lock(&mgmt->ioLatch);
+    RC status = growForWrite(entryBP->fileHandle, page->pageNum + 1);
+    if (status == RC_OK) {
+        status = writeBlock(page->pageNum, entryBP->fileHandle, page->data);
+    }
+    pthread_mutex_unlock(&mgmt->ioLatch);
+    if (status != RC_OK && frame >= 0) {
+        setDirty(mgmt, frame);
+    }
+    POOL_RELEASE(mgmt);
+    if (status != RC_OK) {
+        return status; // Propagate the error from writeBlock
+    }
+
+    // Increment the I/O write counter
+    STAT_ADD(entryBP, writeIO, 1);
+    STAT_ADD(entryBP, writeCalls, 1);
+
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC unpinPage(BM_BufferPool * const bm, BM_PageHandle * const page)
+{
+    return releasePage(bm, page, FALSE);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC unpinPageDirty(BM_BufferPool * const bm, BM_PageHandle * const page)
+{
+    // markDirty() and unpinPage() in one step
+    return releasePage(bm, page, TRUE);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC releasePage(BM_BufferPool *const bm, BM_PageHandle *const page, bool dirty)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND; // Return an error if the buffer pool or its page info is not found
+    }
+
+    Buffer_pool_mgmt *mgmt = entryBP->pool_mgmt;
+    if (dirty) {
+        TRACE(entryBP, BM_TRACE_DIRTY, page->pageNum, FALSE);
+    }
+    TRACE(entryBP, BM_TRACE_UNPIN, page->pageNum, FALSE);
+    POOL_SHARED(mgmt);
+
+    // Our pin keeps the frame named by the handle from changing hands, so no latch is needed
+    int frame = handleFrame(entryBP, page);
+    if (frame >= 0) {
+        Buffer_page_info *frameInfo = &mgmt->pageInfos[frame];
+        if (dirty) {
+            setDirty(mgmt, frame);  // before the pin goes, while the frame is still ours
+        }
+        if (page->latchMode != BM_LATCH_NONE) {
+            unlatchFrame(mgmt, frame, page->latchMode);
+            page->latchMode = BM_LATCH_NONE;
+        }
+        if (ATOMIC_LOAD(&frameInfo->fixcounts) > 0) {
+            POLICY_HOOK(mgmt, on_unpin, frame, dirty);
+            unfixFrame(mgmt, frame);
+            ATOMIC_DEC(&entryBP->pinnedNow);
+        }
+    } else {
+        PageTable_Stripe *stripe = STRIPE_OF(mgmt, entryBP->fileHandle, page->pageNum);
+        pthread_mutex_lock(&stripe->latch);
+        frame = lookupFrame(mgmt, entryBP->fileHandle, page->pageNum);
+        if (frame >= 0 && dirty) {
+            setDirty(mgmt, frame);
+        }
+        if (frame >= 0 && page->latchMode != BM_LATCH_NONE) {
+            unlatchFrame(mgmt, frame, page->latchMode);
+            page->latchMode = BM_LATCH_NONE;
+        }
+        if (frame >= 0 && ATOMIC_LOAD(&mgmt->pageInfos[frame].fixcounts) > 0) {
+            POLICY_HOOK(mgmt, on_unpin, frame, dirty);
+            unfixFrame(mgmt, frame);
+            ATOMIC_DEC(&entryBP->pinnedNow);
+        }
+        pthread_mutex_unlock(&stripe->latch);
+    }
+    POOL_RELEASE(mgmt);
+
+    return (frame >= 0) ? RC_OK : RC_UNPIN_FAILED; // Return error if no matching page number is found
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC pinPage(BM_BufferPool * const bm, BM_PageHandle * const page, const PageNumber pageNum)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        clearHandle(page);
+        return RC_BUFFER_POOL_NOT_FOUND;
+    }
+
+    Buffer_pool_mgmt *mgmt = entryBP->pool_mgmt;
+    long long startNs = nowNs();
+    RC status;
+
+    POOL_SHARED(mgmt);
+    if (mgmt->admission != NULL) {
+        sketchIncrement(mgmt->admission, entryBP->fileHandle, pageNum);
+    }
+    for (;;) {
+        // Fast path: the page is already resident (or on its way in)
+        status = pinResident(entryBP, page, pageNum);
+        if (status != RC_PAGE_NOT_FOUND) {
+            if (status == RC_OK) {
+                notePinned(entryBP, pageNum, startNs, TRUE);
+            }
+            break;
+        }
+
+        // Miss: take a frame from the replacement strategy and read the page into it
+        int frame;
+        status = getVictimFrame(bm, entryBP, &frame, TRUE, pageNum);
+        if (status != RC_OK) {
+            break;
+        }
+
+        status = loadPageIntoFrame(entryBP, frame, page, pageNum, FALSE);
+        if (status != RC_PAGE_NOT_FOUND) {
+            if (status == RC_OK) {
+                notePinned(entryBP, pageNum, startNs, FALSE);
+            }
+            break;
+        }
+        // Another thread loaded the page meanwhile; pin its copy instead
+    }
+    POOL_RELEASE(mgmt);
+    if (status != RC_OK) {
+        clearHandle(page);
+    }
+    return status;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC pinNewPage(BM_BufferPool *const bm, BM_PageHandle *const page)
+{
+    return pinNewPageLatched(bm, page, BM_LATCH_NONE);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC pinNewPageExclusive(BM_BufferPool *const bm, BM_PageHandle *const page)
+{
+    return pinNewPageLatched(bm, page, BM_LATCH_EXCLUSIVE);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC pinNewPageLatched(BM_BufferPool *const bm, BM_PageHandle *const page, BM_LatchMode mode)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        clearHandle(page);
+        return RC_BUFFER_POOL_NOT_FOUND;
+    }
+
+    Buffer_pool_mgmt *mgmt = entryBP->pool_mgmt;
+    long long startNs = nowNs();
+    RC status;
+
+    // Always admitted: a new page is about to be filled, whatever the admission filter counted
+    POOL_SHARED(mgmt);
+    for (;;) {
+        PageNumber pageNum = allocatePage(entryBP->fileHandle);
+        int frame;
+        status = getVictimFrame(bm, entryBP, &frame, TRUE, NO_PAGE);
+        if (status != RC_OK) {
+            freeNewPage(entryBP->fileHandle, pageNum);
+            break;
+        }
+
+        status = mapNewPage(entryBP, frame, page, pageNum, mode);
+        if (status != RC_PAGE_NOT_FOUND) {
+            if (status == RC_OK) {
+                notePinned(entryBP, pageNum, startNs, FALSE);
+                STAT_ADD(entryBP, newPages, 1);
+            }
+            break;
+        }
+        // A pinPage past the end of the file grew it to this page meanwhile; take the next
+    }
+    POOL_RELEASE(mgmt);
+    if (status != RC_OK) {
+        clearHandle(page);
+    }
+    return status;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+int getNumFilePages(BM_BufferPool *const bm)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        return 0;
+    }
+    return filePages(entryBP->fileHandle);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int filePages(SM_FileHandle *file)
+{
+    // Pages in the file plus those pinNewPage handed out and nobody wrote yet; takes no latch
+    int allocated = ATOMIC_LOAD(&((Pool_file *)file)->nextNewPage);
+    int inFile = ATOMIC_LOAD(&file->totalNumPages);
+    return (allocated > inFile) ? allocated : inFile;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static PageNumber allocatePage(SM_FileHandle *file)
+{
+    // The first page past both the file and the pages allocated before
+    Pool_file *poolFile = (Pool_file *)file;
+    int next = ATOMIC_LOAD(&poolFile->nextNewPage);
+    for (;;) {
+        int pageNum = (next > file->totalNumPages) ? next : file->totalNumPages;
+        if (__atomic_compare_exchange_n(&poolFile->nextNewPage, &next, pageNum + 1, FALSE,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return pageNum;
+        }
+    }
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void freeNewPage(SM_FileHandle *file, PageNumber pageNum)
+{
+    // Hands an unused page number back when it is still the last one allocated;
+    // otherwise it stays a hole that reads as zeros once a later page is written
+    int next = pageNum + 1;
+    __atomic_compare_exchange_n(&((Pool_file *)file)->nextNewPage, &next, pageNum, FALSE,
+                                __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC pinPageShared(BM_BufferPool * const bm, BM_PageHandle * const page, const PageNumber pageNum)
+{
+    return pinPageLatched(bm, page, pageNum, BM_LATCH_SHARED);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC pinPageExclusive(BM_BufferPool * const bm, BM_PageHandle * const page, const PageNumber pageNum)
+{
+    return pinPageLatched(bm, page, pageNum, BM_LATCH_EXCLUSIVE);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC pinPageLatched(BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber pageNum, BM_LatchMode mode)
+{
+    // The pin comes first, so the frame cannot change hands while we wait for the latch
+    RC status = pinPage(bm, page, pageNum);
+    if (status != RC_OK) {
+        return status;
+    }
+    status = latchPage(bm, page, mode);
+    if (status != RC_OK) {
+        unpinPage(bm, page);
+        clearHandle(page);
+    }
+    return status;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC latchPage(BM_BufferPool *const bm, BM_PageHandle *const page, BM_LatchMode mode)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;
+    }
+    if ((mode != BM_LATCH_SHARED && mode != BM_LATCH_EXCLUSIVE) || page->latchMode != BM_LATCH_NONE) {
+        return RC_ERR;
+    }
+
+    Buffer_pool_mgmt *mgmt = entryBP->pool_mgmt;
+    POOL_SHARED(mgmt);
+    int frame = handleFrame(entryBP, page);
+    if (frame < 0 || ATOMIC_LOAD(&mgmt->pageInfos[frame].fixcounts) == 0) {
+        POOL_RELEASE(mgmt);
+        return RC_PAGE_NOT_FOUND;  // only pinned pages can be latched
+    }
+    latchFrame(entryBP, frame, mode);
+    page->latchMode = mode;
+    POOL_RELEASE(mgmt);
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC pinPageHint(BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber pageNum, BM_PinHint hint)
+{
+    if (hint != BM_HINT_NORMAL && hint != BM_HINT_KEEP && hint != BM_HINT_EVICT_SOON) {
+        return RC_ERR;
+    }
+    RC status = pinPage(bm, page, pageNum);
+    if (status == RC_OK) {
+        status = setPageHint(bm, page, hint);
+    }
+    return status;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC setPageHint(BM_BufferPool *const bm, BM_PageHandle *const page, BM_PinHint hint)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;
+    }
+    if (hint != BM_HINT_NORMAL && hint != BM_HINT_KEEP && hint != BM_HINT_EVICT_SOON) {
+        return RC_ERR;
+    }
+
+    // The caller's pin keeps the page in its frame while the hint is set
+    Buffer_pool_mgmt *mgmt = entryBP->pool_mgmt;
+    POOL_SHARED(mgmt);
+    int frame = handleFrame(entryBP, page);
+    if (frame < 0 || ATOMIC_LOAD(&mgmt->pageInfos[frame].fixcounts) == 0) {
+        POOL_RELEASE(mgmt);
+        return RC_PAGE_NOT_FOUND;
+    }
+    setFrameHint(mgmt, frame, hint);
+    POOL_RELEASE(mgmt);
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC pinResident(BufferPool_Entry *entry_bp, BM_PageHandle *const page, const PageNumber pageNum)
+{
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+    PageTable_Stripe *stripe = STRIPE_OF(mgmt, entry_bp->fileHandle, pageNum);
+
+    pthread_mutex_lock(&stripe->latch);
+    for (;;) {
+        int frame = lookupFrame(mgmt, entry_bp->fileHandle, pageNum);
+        if (frame < 0) {
+            pthread_mutex_unlock(&stripe->latch);
+            return RC_PAGE_NOT_FOUND;
+        }
+
+        Buffer_page_info *frameInfo = &mgmt->pageInfos[frame];
+        if (frameInfo->ioInProgress) {
+            // Someone else is reading the page; wait for it rather than issuing a second read
+            pthread_cond_wait(&stripe->ioDone, &stripe->latch);
+            continue;  // the read may have failed and dropped the mapping
+        }
+
+        ATOMIC_INC(&frameInfo->fixcounts);
+        ATOMIC_INC(&frameInfo->version);  // a pinner may write, so optimistic readers must retry
+        if (frameInfo->prefetched) {
+            frameInfo->prefetched = FALSE;
+            STAT_ADD(entry_bp, prefetchHits, 1);
+        }
+        if (ATOMIC_LOAD(&frameInfo->hint) == BM_HINT_EVICT_SOON) {
+            setFrameHint(mgmt, frame, BM_HINT_NORMAL);  // used again after all
+        }
+        ATOMIC_STORE(&frameInfo->timeStamp, __atomic_fetch_add(&time_uni, 1, __ATOMIC_RELAXED));
+        POLICY_HOOK(mgmt, on_pin, frame);
+        page->pageNum = pageNum;
+        page->data = frameInfo->pageframes;
+        page->frame = frame;
+        page->generation = frameInfo->generation;
+        page->latchMode = BM_LATCH_NONE;
+        pthread_mutex_unlock(&stripe->latch);
+        return RC_OK;
+    }
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC loadPageIntoFrame(BufferPool_Entry *entry_bp, int frame, BM_PageHandle *const page, const PageNumber pageNum, bool prefetch)
+{
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+    Buffer_page_info *frameInfo = &mgmt->pageInfos[frame];
+    SM_FileHandle *fileHandle = entry_bp->fileHandle;
+    PageTable_Stripe *stripe = STRIPE_OF(mgmt, fileHandle, pageNum);
+
+    // Publish the mapping first so concurrent pinners of the page wait for this read
+    pthread_mutex_lock(&stripe->latch);
+    if (lookupFrame(mgmt, fileHandle, pageNum) >= 0) {
+        pthread_mutex_unlock(&stripe->latch);
+        releaseFrame(mgmt, frame);
+        return RC_PAGE_NOT_FOUND;
+    }
+    ATOMIC_STORE(&frameInfo->pagenums, pageNum);
+    ATOMIC_STORE(&frameInfo->file, fileHandle);
+    frameInfo->generation++;
+    frameInfo->prefetched = prefetch;  // before pinners can see the page, so their pin is a prefetch hit
+    ATOMIC_STORE(&frameInfo->isdirty, FALSE);
+    ATOMIC_STORE(&frameInfo->ioInProgress, TRUE);
+    insertFrame(mgmt, frame);
+    pthread_mutex_unlock(&stripe->latch);
+
+    // The read itself happens without any page table latch held; a compressed copy saves it
+    RC status = RC_OK;
+    bool fromTier = (mgmt->tier != NULL && compressedCacheTake(mgmt->tier, fileHandle, pageNum, frameInfo->pageframes));
+    if (!fromTier) {
+        pthread_mutex_lock(&mgmt->ioLatch);
+        status = readBlock(pageNum, fileHandle, frameInfo->pageframes);
+        if (status == RC_READ_NON_EXISTING_PAGE || status == RC_OUT_OF_BOUNDS) {
+            // Grow the file so that the requested page exists, then read it
+            status = ensureCapacity(pageNum + 1, fileHandle);
+            if (status == RC_OK) {
+                status = readBlock(pageNum, fileHandle, frameInfo->pageframes);
+            }
+        }
+        pthread_mutex_unlock(&mgmt->ioLatch);
+    }
+
+    pthread_mutex_lock(&stripe->latch);
+    ATOMIC_STORE(&frameInfo->ioInProgress, FALSE);
+    if (status != RC_OK) {
+        removeFrame(mgmt, frame);
+        frameInfo->prefetched = FALSE;
+        ATOMIC_STORE(&frameInfo->pagenums, NO_PAGE);
+        ATOMIC_STORE(&frameInfo->file, NULL);
+        pthread_cond_broadcast(&stripe->ioDone);
+        pthread_mutex_unlock(&stripe->latch);
+        unfixFrame(mgmt, frame);
+        return status;
+    }
+
+    if (fromTier) {
+        STAT_ADD(entry_bp, tierHits, 1);
+    } else {
+        STAT_ADD(entry_bp, readIO, 1);
+    }
+    ATOMIC_INC(&frameInfo->version);
+    ATOMIC_STORE(&frameInfo->timeStamp, __atomic_fetch_add(&time_uni, 1, __ATOMIC_RELAXED));
+    POLICY_HOOK(mgmt, on_load, frame, pageNum);
+    pthread_cond_broadcast(&stripe->ioDone);
+    pthread_mutex_unlock(&stripe->latch);
+
+    // The claim on the frame becomes the caller's pin
+    page->pageNum = pageNum;
+    page->data = frameInfo->pageframes;
+    page->frame = frame;
+    page->generation = frameInfo->generation;
+    page->latchMode = BM_LATCH_NONE;
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC mapNewPage(BufferPool_Entry *entry_bp, int frame, BM_PageHandle *const page, const PageNumber pageNum, BM_LatchMode mode)
+{
+    // Like loadPageIntoFrame, but the page is zeroed instead of read and starts out dirty
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+    Buffer_page_info *frameInfo = &mgmt->pageInfos[frame];
+    SM_FileHandle *fileHandle = entry_bp->fileHandle;
+    PageTable_Stripe *stripe = STRIPE_OF(mgmt, fileHandle, pageNum);
+
+    // The claimed frame is ours alone, so it is zeroed and latched before anyone can find it
+    memset(frameInfo->pageframes, 0, PAGE_SIZE);
+    if (mode == BM_LATCH_EXCLUSIVE) {
+        __atomic_store_n(&frameInfo->latch, -1, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_lock(&stripe->latch);
+    if (lookupFrame(mgmt, fileHandle, pageNum) >= 0) {
+        pthread_mutex_unlock(&stripe->latch);
+        __atomic_store_n(&frameInfo->latch, 0, __ATOMIC_SEQ_CST);
+        releaseFrame(mgmt, frame);
+        return RC_PAGE_NOT_FOUND;
+    }
+    ATOMIC_STORE(&frameInfo->pagenums, pageNum);
+    ATOMIC_STORE(&frameInfo->file, fileHandle);
+    frameInfo->generation++;
+    frameInfo->prefetched = FALSE;
+    ATOMIC_STORE(&frameInfo->isdirty, FALSE);
+    insertFrame(mgmt, frame);
+    setDirty(mgmt, frame);
+    ATOMIC_INC(&frameInfo->version);
+    ATOMIC_STORE(&frameInfo->timeStamp, __atomic_fetch_add(&time_uni, 1, __ATOMIC_RELAXED));
+    POLICY_HOOK(mgmt, on_load, frame, pageNum);
+    pthread_mutex_unlock(&stripe->latch);
+
+    // The claim on the frame becomes the caller's pin
+    page->pageNum = pageNum;
+    page->data = frameInfo->pageframes;
+    page->frame = frame;
+    page->generation = frameInfo->generation;
+    page->latchMode = mode;
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int lookupFrame(Buffer_pool_mgmt *mgmt, SM_FileHandle *file, PageNumber pageNum)
+{
+    // Caller holds the latch of the page's stripe
+    for (int frame = mgmt->buckets[BUCKET_OF(mgmt, file, pageNum)]; frame >= 0; frame = mgmt->pageInfos[frame].hashNext) {
+        if (mgmt->pageInfos[frame].pagenums == pageNum && mgmt->pageInfos[frame].file == file) {
+            return frame;
+        }
+    }
+    return -1;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int handleFrame(BufferPool_Entry *entry_bp, BM_PageHandle *const page)
+{
+    // Frame recorded in the handle by pinPage, or -1 if the handle does not (or no longer)
+    // describe it; caller holds the resize latch
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+    int frame = page->frame;
+    if (frame < 0 || frame >= mgmt->numFrames) {
+        return -1;
+    }
+
+    Buffer_page_info *frameInfo = &mgmt->pageInfos[frame];
+    if (frameInfo->generation != page->generation || ATOMIC_LOAD(&frameInfo->pagenums) != page->pageNum
+        || ATOMIC_LOAD(&frameInfo->file) != entry_bp->fileHandle) {
+        return -1;
+    }
+    return frame;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void clearHandle(BM_PageHandle *const page)
+{
+    // A failed pin leaves the handle naming no frame, so a stray unpin or latch finds nothing
+    page->frame = -1;
+    page->generation = 0;
+    page->latchMode = BM_LATCH_NONE;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void insertFrame(Buffer_pool_mgmt *mgmt, int frame)
+{
+    int bucket = BUCKET_OF(mgmt, mgmt->pageInfos[frame].file, mgmt->pageInfos[frame].pagenums);
+    mgmt->pageInfos[frame].hashNext = mgmt->buckets[bucket];
+    mgmt->buckets[bucket] = frame;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void removeFrame(Buffer_pool_mgmt *mgmt, int frame)
+{
+    int *link = &mgmt->buckets[BUCKET_OF(mgmt, mgmt->pageInfos[frame].file, mgmt->pageInfos[frame].pagenums)];
+    while (*link >= 0) {
+        if (*link == frame) {
+            *link = mgmt->pageInfos[frame].hashNext;
+            break;
+        }
+        link = &mgmt->pageInfos[*link].hashNext;
+    }
+    mgmt->pageInfos[frame].hashNext = -1;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int claimFrame(BufferPool_Entry *entry_bp, int frame, PageNumber expected)
+{
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+    Buffer_page_info *frameInfo = &mgmt->pageInfos[frame];
+    PageNumber oldPage = ATOMIC_LOAD(&frameInfo->pagenums);
+    SM_FileHandle *oldFile = ATOMIC_LOAD(&frameInfo->file);
+
+    if (oldPage == NO_PAGE) {
+        // Unmapped frames are only handed out under replLatch, so nobody else can pin them
+        if (expected != NO_PAGE) {
+            return CLAIM_BUSY;
+        }
+        int unfixed = 0;
+        return __atomic_compare_exchange_n(&frameInfo->fixcounts, &unfixed, 1, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+               ? CLAIM_OK : CLAIM_BUSY;
+    }
+
+    PageTable_Stripe *stripe = STRIPE_OF(mgmt, oldFile, oldPage);
+    pthread_mutex_lock(&stripe->latch);
+    if (frameInfo->pagenums != oldPage || frameInfo->file != oldFile
+        || (expected != NO_PAGE && (oldPage != expected || oldFile != entry_bp->fileHandle))
+        || frameInfo->ioInProgress || ATOMIC_LOAD(&frameInfo->fixcounts) != 0) {
+        pthread_mutex_unlock(&stripe->latch);
+        return CLAIM_BUSY;
+    }
+
+    if (ATOMIC_LOAD(&frameInfo->isdirty)) {
+        // Write the victim back while it stays mapped, so readers never see a stale disk copy
+        ATOMIC_INC(&frameInfo->fixcounts);
+        pthread_mutex_unlock(&stripe->latch);
+        pthread_mutex_unlock(&mgmt->replLatch);
+        if (flushAround(entry_bp, frame) == RC_OK) {
+            STAT_ADD(entry_bp, evictionWrites, 1);
+        }
+        unfixFrame(mgmt, frame);
+        pthread_mutex_lock(&mgmt->replLatch);
+        return CLAIM_FLUSHED;
+    }
+
+    if (mgmt->tier != NULL) {
+        // Compress with the frame fixed and both latches dropped, like the write back above.
+        // A pin meanwhile bumps the version or keeps a fix, and then the claim is given up
+        char packed[CC_MAX_STORED];
+        unsigned int version = ATOMIC_LOAD(&frameInfo->version);
+        ATOMIC_INC(&frameInfo->fixcounts);
+        pthread_mutex_unlock(&stripe->latch);
+        pthread_mutex_unlock(&mgmt->replLatch);
+        int length = compressedCachePack(frameInfo->pageframes, packed);
+        pthread_mutex_lock(&mgmt->replLatch);
+        pthread_mutex_lock(&stripe->latch);
+        if (frameInfo->pagenums != oldPage || frameInfo->file != oldFile || ATOMIC_LOAD(&frameInfo->isdirty) || frameInfo->ioInProgress
+            || ATOMIC_LOAD(&frameInfo->fixcounts) != 1 || ATOMIC_LOAD(&frameInfo->version) != version) {
+            pthread_mutex_unlock(&stripe->latch);
+            unfixFrame(mgmt, frame);
+            return CLAIM_BUSY;
+        }
+        // Stored under the stripe latch, so a miss on the page finds either the frame or the copy
+        if (compressedCacheStore(mgmt->tier, oldFile, oldPage, packed, length)) {
+            STAT_ADD(entry_bp, tierStores, 1);
+        }
+    }
+    removeFrame(mgmt, frame);
+    POLICY_HOOK(mgmt, on_evict, frame);
+    setFrameHint(mgmt, frame, BM_HINT_NORMAL);
+    ATOMIC_STORE(&frameInfo->pagenums, NO_PAGE);
+    ATOMIC_STORE(&frameInfo->file, NULL);
+    ATOMIC_STORE(&frameInfo->fixcounts, 1);
+    ATOMIC_INC(&frameInfo->version);
+    STAT_ADD(entry_bp, evictions, 1);
+    if (frameInfo->prefetched) {
+        frameInfo->prefetched = FALSE;
+        STAT_ADD(entry_bp, prefetchWasted, 1);
+    }
+    pthread_mutex_unlock(&stripe->latch);
+    return CLAIM_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void releaseFrame(Buffer_pool_mgmt *mgmt, int frame)
+{
+    // Give back a claimed frame that ended up unused
+    unfixFrame(mgmt, frame);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void unfixFrame(Buffer_pool_mgmt *mgmt, int frame)
+{
+    // Drops one fix. Sequentially consistent against waitForFrame: either the waiter
+    // sees the frame free when it rechecks, or we see the waiter and wake it
+    if (__atomic_sub_fetch(&mgmt->pageInfos[frame].fixcounts, 1, __ATOMIC_SEQ_CST) == 0
+        && __atomic_load_n(&mgmt->pinWaiters, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&mgmt->waitLatch);
+        pthread_cond_broadcast(&mgmt->frameFreed);
+        pthread_mutex_unlock(&mgmt->waitLatch);
+    }
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void latchFrame(BufferPool_Entry *entry_bp, int frame, BM_LatchMode mode)
+{
+    // Caller pins the frame and holds the resize latch shared, which is safe to sleep
+    // with: the holder we wait for drops the page latch under a shared resize latch too
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+    int *latch = &mgmt->pageInfos[frame].latch;
+    bool waited = FALSE;
+
+    for (;;) {
+        int state = __atomic_load_n(latch, __ATOMIC_SEQ_CST);
+        if (mode == BM_LATCH_SHARED ? state >= 0 : state == 0) {
+            if (__atomic_compare_exchange_n(latch, &state, (mode == BM_LATCH_SHARED) ? state + 1 : -1, FALSE,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+                return;
+            }
+            continue;
+        }
+
+        if (!waited) {
+            waited = TRUE;
+            STAT_ADD(entry_bp, latchWaits, 1);
+        }
+        // Recheck after announcing ourselves, so a release in between is not missed
+        __atomic_add_fetch(&mgmt->latchWaiters, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_lock(&mgmt->latchWaitLatch);
+        state = __atomic_load_n(latch, __ATOMIC_SEQ_CST);
+        if (mode == BM_LATCH_SHARED ? state < 0 : state != 0) {
+            pthread_cond_wait(&mgmt->latchFreed, &mgmt->latchWaitLatch);
+        }
+        pthread_mutex_unlock(&mgmt->latchWaitLatch);
+        __atomic_sub_fetch(&mgmt->latchWaiters, 1, __ATOMIC_SEQ_CST);
+    }
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void unlatchFrame(Buffer_pool_mgmt *mgmt, int frame, BM_LatchMode mode)
+{
+    // Sequentially consistent against latchFrame, like unfixFrame against waitForFrame
+    int *latch = &mgmt->pageInfos[frame].latch;
+    int state = (mode == BM_LATCH_SHARED) ? __atomic_sub_fetch(latch, 1, __ATOMIC_SEQ_CST) : 0;
+    if (mode != BM_LATCH_SHARED) {
+        __atomic_store_n(latch, 0, __ATOMIC_SEQ_CST);
+    }
+    if (state == 0 && __atomic_load_n(&mgmt->latchWaiters, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&mgmt->latchWaitLatch);
+        pthread_cond_broadcast(&mgmt->latchFreed);
+        pthread_mutex_unlock(&mgmt->latchWaitLatch);
+    }
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void setFrameHint(Buffer_pool_mgmt *mgmt, int frame, BM_PinHint hint)
+{
+    // Pins of the same page may hint it concurrently: the exchange keeps the counts exact
+    int old = __atomic_exchange_n(&mgmt->pageInfos[frame].hint, (int)hint, __ATOMIC_ACQ_REL);
+    if (old == (int)hint) {
+        return;
+    }
+    if (old == BM_HINT_KEEP) {
+        ATOMIC_DEC(&mgmt->keptFrames);
+    } else if (old == BM_HINT_EVICT_SOON) {
+        ATOMIC_DEC(&mgmt->evictSoonFrames);
+    }
+    if (hint == BM_HINT_KEEP) {
+        ATOMIC_INC(&mgmt->keptFrames);
+    } else if (hint == BM_HINT_EVICT_SOON) {
+        ATOMIC_INC(&mgmt->evictSoonFrames);
+    }
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void setDirty(Buffer_pool_mgmt *mgmt, int frame)
+{
+    // Flag first, then bit: a flush that clears the bit in between still sees the flag.
+    // Cleaning only drops the flag, so the bitmap may hold stale bits but never misses a dirty frame
+    ATOMIC_STORE(&mgmt->pageInfos[frame].isdirty, TRUE);
+    __atomic_fetch_or(&mgmt->dirtyMap[DIRTY_WORD(frame)], DIRTY_BIT(frame), __ATOMIC_ACQ_REL);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int compareDirtyPages(const void *a, const void *b)
+{
+    PageNumber pa = ((const Dirty_page *)a)->pageNum;
+    PageNumber pb = ((const Dirty_page *)b)->pageNum;
+    return (pa > pb) - (pa < pb);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int collectDirtyFrames(Buffer_pool_mgmt *mgmt, SM_FileHandle *file, Dirty_page *pages)
+{
+    // Takes the file's frames out of the dirty bitmap and returns those still dirty,
+    // sorted by page number; callers put back what they do not clean
+    int count = 0;
+    for (int word = 0; word < mgmt->dirtyWords; word++) {
+        unsigned long long bits = __atomic_load_n(&mgmt->dirtyMap[word], __ATOMIC_ACQUIRE);
+        while (bits != 0) {
+            int frame = word * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            if (frame >= mgmt->numFrames || ATOMIC_LOAD(&mgmt->pageInfos[frame].file) != file) {
+                continue;
+            }
+            __atomic_fetch_and(&mgmt->dirtyMap[word], ~DIRTY_BIT(frame), __ATOMIC_ACQ_REL);
+            PageNumber pageNum = ATOMIC_LOAD(&mgmt->pageInfos[frame].pagenums);
+            if (ATOMIC_LOAD(&mgmt->pageInfos[frame].isdirty) && pageNum != NO_PAGE) {
+                pages[count].pageNum = pageNum;
+                pages[count++].frame = frame;
+            }
+        }
+    }
+    qsort(pages, count, sizeof(Dirty_page), compareDirtyPages);
+    return count;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC writeRun(BufferPool_Entry *entry_bp, const int *frames, int count)
+{
+    // Caller keeps the frames pinned once each and they hold consecutive pages of one file.
+    // The write works from a snapshot, so a page pinned while it is under way can change
+    // right away instead of racing with the write
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+    Buffer_page_info *first = &mgmt->pageInfos[frames[0]];
+    SM_PageHandle pages[WRITE_RUN_MAX];
+    bool changing[WRITE_RUN_MAX];
+    char *shadow = malloc((size_t)count * PAGE_SIZE);
+
+    // Dirty flags are cleared before the copy, so a change after it dirties the page again.
+    // A page somebody else pinned around the copy may be half way through a change: it is
+    // written, but stays dirty
+    for (int i = 0; i < count; i++) {
+        Buffer_page_info *frameInfo = &mgmt->pageInfos[frames[i]];
+        unsigned int version = ATOMIC_LOAD(&frameInfo->version);
+        bool shared = ATOMIC_LOAD(&frameInfo->fixcounts) > 1;
+        ATOMIC_STORE(&frameInfo->isdirty, FALSE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (shadow == NULL) {
+            pages[i] = frameInfo->pageframes;  // no memory for a snapshot: write the frame itself
+        } else {
+            pages[i] = shadow + (size_t)i * PAGE_SIZE;
+            memcpy(pages[i], frameInfo->pageframes, PAGE_SIZE);
+        }
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        changing[i] = shared || ATOMIC_LOAD(&frameInfo->fixcounts) > 1 || ATOMIC_LOAD(&frameInfo->version) != version;
+    }
+
+    pthread_mutex_lock(&mgmt->ioLatch);
+    RC status = growForWrite(first->file, first->pagenums + count);
+    if (status == RC_OK) {
+        status = (count == 1) ? writeBlock(first->pagenums, first->file, pages[0])
+                              : writeBlocks(first->pagenums, count, first->file, pages);
+    }
+    pthread_mutex_unlock(&mgmt->ioLatch);
+    free(shadow);
+
+    for (int i = 0; i < count; i++) {
+        if (status != RC_OK || changing[i]) {
+            setDirty(mgmt, frames[i]);
+        }
+        if (status == RC_OK && changing[i]) {
+            STAT_ADD(entry_bp, pinnedWrites, 1);
+        }
+    }
+    if (status == RC_OK) {
+        STAT_ADD(entry_bp, writeIO, count);
+        STAT_ADD(entry_bp, writeCalls, 1);
+    }
+    return status;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC flushFrame(BufferPool_Entry *entry_bp, int frame)
+{
+    // Caller keeps the frame pinned
+    return writeRun(entry_bp, &frame, 1);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC growForWrite(SM_FileHandle *file, PageNumber endPage)
+{
+    // Caller holds ioLatch. Pages from pinNewPage lie past the end of the file until
+    // their first write; the file grows to hold them without writing zeros first
+    if (endPage <= file->totalNumPages) {
+        return RC_OK;
+    }
+    return extendPageFile(endPage, file);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static bool pinFlushable(Buffer_pool_mgmt *mgmt, int frame, SM_FileHandle *file, PageNumber pageNum)
+{
+    // Pins the frame if it still holds the page, is dirty and nobody else holds it
+    Buffer_page_info *frameInfo = &mgmt->pageInfos[frame];
+    PageTable_Stripe *stripe = STRIPE_OF(mgmt, file, pageNum);
+    pthread_mutex_lock(&stripe->latch);
+    bool flushable = (frameInfo->pagenums == pageNum && frameInfo->file == file && ATOMIC_LOAD(&frameInfo->isdirty)
+                      && !frameInfo->ioInProgress && ATOMIC_LOAD(&frameInfo->fixcounts) == 0);
+    if (flushable) {
+        ATOMIC_INC(&frameInfo->fixcounts);
+    }
+    pthread_mutex_unlock(&stripe->latch);
+    return flushable;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int pinDirtyPage(Buffer_pool_mgmt *mgmt, SM_FileHandle *file, PageNumber pageNum)
+{
+    // Same as pinFlushable, for a page looked up in the page table; -1 if it cannot be cleaned now
+    PageTable_Stripe *stripe = STRIPE_OF(mgmt, file, pageNum);
+    pthread_mutex_lock(&stripe->latch);
+    int frame = lookupFrame(mgmt, file, pageNum);
+    if (frame >= 0) {
+        Buffer_page_info *frameInfo = &mgmt->pageInfos[frame];
+        if (ATOMIC_LOAD(&frameInfo->isdirty) && !frameInfo->ioInProgress && ATOMIC_LOAD(&frameInfo->fixcounts) == 0) {
+            ATOMIC_INC(&frameInfo->fixcounts);
+        } else {
+            frame = -1;
+        }
+    }
+    pthread_mutex_unlock(&stripe->latch);
+    return frame;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC flushUnpinnedFrame(BufferPool_Entry *entry_bp, int frame)
+{
+    // Writes a dirty frame nobody holds; returns RC_PAGE_NOT_FOUND if it was skipped
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+    Buffer_page_info *frameInfo = &mgmt->pageInfos[frame];
+    PageNumber pageNum = ATOMIC_LOAD(&frameInfo->pagenums);
+    if (pageNum == NO_PAGE) {
+        return RC_PAGE_NOT_FOUND;
+    }
+
+    // Hold a pin while writing so the frame cannot be evicted underneath us
+    if (!pinFlushable(mgmt, frame, ATOMIC_LOAD(&frameInfo->file), pageNum)) {
+        return RC_PAGE_NOT_FOUND;
+    }
+
+    RC status = flushFrame(entry_bp, frame);
+    unfixFrame(mgmt, frame);
+    return (status == RC_OK) ? RC_OK : RC_WRITE_FAILED;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC finishRun(BufferPool_Entry *entry_bp, const int *frames, int count)
+{
+    // Writes a pinned run and drops the pins
+    RC status = writeRun(entry_bp, frames, count);
+    for (int i = 0; i < count; i++) {
+        unfixFrame(entry_bp->pool_mgmt, frames[i]);
+    }
+    return status;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC flushDirtyRuns(BufferPool_Entry *entry_bp, const Dirty_page *pages, int count)
+{
+    // pages is sorted by page number; pinned pages are skipped and split the run around them.
+    // Stops at the first run that cannot be written
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+    int run[WRITE_RUN_MAX];
+    int runLength = 0;
+    PageNumber lastPage = NO_PAGE;
+
+    for (int i = 0; i < count; i++) {
+        if (!pinFlushable(mgmt, pages[i].frame, entry_bp->fileHandle, pages[i].pageNum)) {
+            continue;
+        }
+        if (runLength > 0 && (pages[i].pageNum != lastPage + 1 || runLength == WRITE_RUN_MAX)) {
+            if (finishRun(entry_bp, run, runLength) != RC_OK) {
+                unfixFrame(mgmt, pages[i].frame);
+                return RC_WRITE_FAILED;
+            }
+            runLength = 0;
+        }
+        run[runLength++] = pages[i].frame;
+        lastPage = pages[i].pageNum;
+    }
+
+    if (runLength > 0 && finishRun(entry_bp, run, runLength) != RC_OK) {
+        return RC_WRITE_FAILED;
+    }
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC flushAround(BufferPool_Entry *entry_bp, int frame)
+{
+    // Writes a pinned dirty victim together with the dirty, unpinned pages right before
+    // and after it, so evicting one page of a bulk load cleans its neighbours in the same call
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+    SM_FileHandle *file = mgmt->pageInfos[frame].file;
+    PageNumber pageNum = mgmt->pageInfos[frame].pagenums;
+    int numPages = filePages(file);
+    int run[2 * EVICT_CLEAN_SPAN + 1];
+    int before = 0;
+    int after = 0;
+
+    // Lower neighbours are collected nearest first and reversed into page order
+    int lower[EVICT_CLEAN_SPAN];
+    while (before < EVICT_CLEAN_SPAN && pageNum - before - 1 >= 0) {
+        int neighbour = pinDirtyPage(mgmt, file, pageNum - before - 1);
+        if (neighbour < 0) {
+            break;
+        }
+        lower[before++] = neighbour;
+    }
+    for (int i = 0; i < before; i++) {
+        run[i] = lower[before - 1 - i];
+    }
+    run[before] = frame;
+    while (after < EVICT_CLEAN_SPAN && pageNum + after + 1 < numPages) {
+        int neighbour = pinDirtyPage(mgmt, file, pageNum + after + 1);
+        if (neighbour < 0) {
+            break;
+        }
+        run[before + 1 + after++] = neighbour;
+    }
+
+    RC status = writeRun(entry_bp, run, before + 1 + after);
+    for (int i = 0; i < before + 1 + after; i++) {
+        if (run[i] != frame) {
+            unfixFrame(mgmt, run[i]);
+        }
+    }
+    return status;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC waitForFrame(BufferPool_Entry *entry_bp, const struct timespec *deadline)
+{
+    // Entered and left with replLatch held. Sleeps until some frame's fix count drops
+    // to zero, or until the deadline when one is given
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+    long long startNs = nowNs();
+    bool freed = FALSE;
+    int rc = 0;
+
+    __atomic_add_fetch(&mgmt->pinWaiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&mgmt->waitLatch);
+    pthread_mutex_unlock(&mgmt->replLatch);
+    while (rc != ETIMEDOUT) {
+        // Recheck after announcing ourselves, so an unpin in between is not missed
+        for (int i = 0; i < mgmt->numFrames && !freed; i++) {
+            freed = __atomic_load_n(&mgmt->pageInfos[i].fixcounts, __ATOMIC_SEQ_CST) == 0
+                    && !ATOMIC_LOAD(&mgmt->pageInfos[i].ioInProgress);
+        }
+        if (freed) {
+            break;
+        }
+        if (deadline == NULL) {
+            rc = pthread_cond_wait(&mgmt->frameFreed, &mgmt->waitLatch);
+        } else {
+            rc = pthread_cond_timedwait(&mgmt->frameFreed, &mgmt->waitLatch, deadline);
+        }
+    }
+    pthread_mutex_unlock(&mgmt->waitLatch);
+    __atomic_sub_fetch(&mgmt->pinWaiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&mgmt->replLatch);
+
+    STAT_ADD(entry_bp, pinWaitNs, nowNs() - startNs);
+    return freed ? RC_OK : RC_PIN_WAIT_TIMEOUT;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC getVictimFrame(BM_BufferPool *const bm, BufferPool_Entry *entry_bp, int *frame, bool mayWait, PageNumber newPage)
+{
+    // newPage, when given, is the missed page the admission filter weighs against the victim
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+    Buffer_page_info *pageInfo = mgmt->pageInfos;
+    int waitMs = mayWait ? ATOMIC_LOAD(&entry_bp->pinWaitMs) : BM_PIN_NO_WAIT;
+    bool waited = FALSE;
+    struct timespec deadline;
+
+    pthread_mutex_lock(&mgmt->replLatch);
+    for (;;) {
+        int candidate = -1;
+        bool refused = FALSE;
+        bool needEviction = (mgmt->freeCount < FREE_LOW_WATER(mgmt->numFrames)
+                             && mgmt->policy != NULL && mgmt->policy->choose_victim != NULL);
+
+        // A miss that needs room is first weighed against the policy's victim; a refused
+        // page does not make room, it takes a transient frame
+        if (needEviction && mgmt->admission != NULL) {
+            int victim = findReplace(mgmt);
+            STAT_ADD(entry_bp, victimSearches, 1);
+            if (victim >= 0) {
+                refused = (newPage != NO_PAGE && !admitMiss(mgmt, entry_bp->fileHandle, newPage, victim));
+                // Pages refused earlier go first, whether the new page is admitted or not
+                for (int i = 0; i < mgmt->numFrames; i++) {
+                    if (pageInfo[i].transient && frameEvictable(mgmt, i)) {
+                        candidate = i;
+                        break;
+                    }
+                }
+                if (candidate < 0 && refused) {
+                    candidate = popFreeFrame(mgmt);
+                    if (candidate < 0) {
+                        candidate = victim;
+                    }
+                }
+            }
+        }
+
+        // Otherwise take a free frame, evicting a batch of victims first when few are left
+        if (candidate < 0) {
+            int victims = needEviction ? refillFreeFrames(entry_bp) : 0;
+            candidate = popFreeFrame(mgmt);
+            if (candidate < 0 && victims > 0) {
+                // Every victim was pinned or written back meanwhile: choose again
+                STAT_ADD(entry_bp, victimRetries, 1);
+                continue;
+            }
+        }
+
+        // Frames unmapped by a failed read are not on the list; without a policy they are all there is
+        for (int i = 0; i < mgmt->numFrames && candidate < 0; i++) {
+            if (ATOMIC_LOAD(&pageInfo[i].pagenums) == NO_PAGE && frameEvictable(mgmt, i)) {
+                candidate = i;
+            }
+        }
+
+        if (candidate < 0 && waitMs != BM_PIN_NO_WAIT) {
+            // Every frame is pinned: sleep until one is unpinned, then choose again
+            if (!waited) {
+                waited = TRUE;
+                STAT_ADD(entry_bp, pinWaits, 1);
+                if (waitMs > 0) {
+                    clock_gettime(CLOCK_MONOTONIC, &deadline);
+                    deadline.tv_sec += waitMs / 1000;
+                    deadline.tv_nsec += (long)(waitMs % 1000) * 1000000L;
+                    if (deadline.tv_nsec >= 1000000000L) {
+                        deadline.tv_sec++;
+                        deadline.tv_nsec -= 1000000000L;
+                    }
+                }
+            }
+            if (waitForFrame(entry_bp, waitMs > 0 ? &deadline : NULL) == RC_OK) {
+                continue;
+            }
+            pthread_mutex_unlock(&mgmt->replLatch);
+            STAT_ADD(entry_bp, pinWaitTimeouts, 1);
+            return RC_PIN_WAIT_TIMEOUT;
+        }
+        if (candidate < 0) {
+            pthread_mutex_unlock(&mgmt->replLatch);
+            switch (bm->strategy) {
+                case RS_FIFO: return RC_FIFO_FAILED;
+                case RS_LRU:  return RC_LRU_FAILED;
+                case RS_LFU:  return RC_LFU_FAILED;
+                default:      return RC_PIN_FAILED;
+            }
+        }
+
+        if (claimFrame(entry_bp, candidate, NO_PAGE) == CLAIM_OK) {
+            pageInfo[candidate].transient = refused;
+            if (refused) {
+                STAT_ADD(entry_bp, admissionRejects, 1);
+            }
+            pthread_mutex_unlock(&mgmt->replLatch);
+            *frame = candidate;
+            return RC_OK;
+        }
+        // The candidate was pinned or written back meanwhile: choose again
+        STAT_ADD(entry_bp, victimRetries, 1);
+    }
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static bool admitMiss(Buffer_pool_mgmt *mgmt, SM_FileHandle *file, PageNumber pageNum, int victim)
+{
+    // Caller holds replLatch. The victim's mapping is read unlatched; a stale one only
+    // skews this guess, claimFrame still checks the frame. Ties keep the resident page
+    const Buffer_page_info *victimInfo = &mgmt->pageInfos[victim];
+    SM_FileHandle *victimFile = ATOMIC_LOAD(&victimInfo->file);
+    PageNumber victimPage = ATOMIC_LOAD(&victimInfo->pagenums);
+    if (victimPage == NO_PAGE || victimFile == NULL) {
+        return TRUE;
+    }
+    return sketchEstimate(mgmt->admission, file, pageNum) > sketchEstimate(mgmt->admission, victimFile, victimPage);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static bool frameEvictable(const void *pool, int frame)
+{
+    const Buffer_page_info *frameInfo = &((const Buffer_pool_mgmt *)pool)->pageInfos[frame];
+    return ATOMIC_LOAD(&frameInfo->fixcounts) == 0 && !ATOMIC_LOAD(&frameInfo->ioInProgress)
+           && !frameInfo->onFreeList && !frameInfo->evicting
+           && !(((const Buffer_pool_mgmt *)pool)->sparingKept && ATOMIC_LOAD(&frameInfo->hint) == BM_HINT_KEEP);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int popFreeFrame(Buffer_pool_mgmt *mgmt)
+{
+    // Caller holds replLatch; claimFrame still has to take the frame
+    while (mgmt->freeCount > 0) {
+        int frame = mgmt->freeFrames[--mgmt->freeCount];
+        mgmt->pageInfos[frame].onFreeList = FALSE;
+        if (ATOMIC_LOAD(&mgmt->pageInfos[frame].pagenums) == NO_PAGE) {
+            return frame;
+        }
+    }
+    return -1;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int refillFreeFrames(BufferPool_Entry *entry_bp)
+{
+    // Caller holds replLatch, dropped while dirty victims are written. Evicts a batch of
+    // victims in one go: the dirty pages of the caller's file among them are written
+    // together in page order, any others by claimFrame. Returns the victims chosen,
+    // some of which may have been pinned again before they could be evicted
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+    Buffer_page_info *pageInfo = mgmt->pageInfos;
+    int victims[FREE_BATCH_MAX];
+    bool batchWritten[FREE_BATCH_MAX];
+    Dirty_page dirty[FREE_BATCH_MAX];
+    int numVictims = 0;
+    int numDirty = 0;
+    int batch = FREE_BATCH(mgmt->numFrames);
+
+    while (numVictims < batch) {
+        int victim = findReplace(mgmt);
+        STAT_ADD(entry_bp, victimSearches, 1);
+        if (victim < 0) {
+            break;
+        }
+        pageInfo[victim].evicting = TRUE;  // the policy must not offer it again
+        batchWritten[numVictims] = FALSE;
+        PageNumber victimPage = ATOMIC_LOAD(&pageInfo[victim].pagenums);
+        if (ATOMIC_LOAD(&pageInfo[victim].isdirty) && victimPage != NO_PAGE
+            && ATOMIC_LOAD(&pageInfo[victim].file) == entry_bp->fileHandle) {
+            dirty[numDirty].pageNum = victimPage;
+            dirty[numDirty++].frame = victim;
+            batchWritten[numVictims] = TRUE;
+        }
+        victims[numVictims++] = victim;
+    }
+    if (numVictims == 0) {
+        return 0;
+    }
+    STAT_ADD(entry_bp, freeRefills, 1);
+
+    // A lone dirty victim is left to claimFrame, which also cleans its dirty neighbours
+    if (numDirty > 1) {
+        pthread_mutex_unlock(&mgmt->replLatch);
+        qsort(dirty, numDirty, sizeof(Dirty_page), compareDirtyPages);
+        flushDirtyRuns(entry_bp, dirty, numDirty);
+        pthread_mutex_lock(&mgmt->replLatch);
+    } else {
+        numDirty = 0;
+    }
+
+    for (int i = 0; i < numVictims; i++) {
+        int victim = victims[i];
+        pageInfo[victim].evicting = FALSE;
+        int claim = claimFrame(entry_bp, victim, NO_PAGE);
+        if (claim == CLAIM_FLUSHED) {
+            // Written by claimFrame after all, which counted the write
+            batchWritten[i] = FALSE;
+            claim = claimFrame(entry_bp, victim, NO_PAGE);
+        }
+        if (claim != CLAIM_OK) {
+            continue;  // pinned again meanwhile
+        }
+        if (numDirty > 0 && batchWritten[i]) {
+            STAT_ADD(entry_bp, evictionWrites, 1);
+        }
+        pageInfo[victim].transient = FALSE;
+        if (mgmt->freeCount < mgmt->freeCapacity) {
+            pageInfo[victim].onFreeList = TRUE;
+            mgmt->freeFrames[mgmt->freeCount++] = victim;
+        }
+        unfixFrame(mgmt, victim);
+    }
+    return numVictims;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void rebuildFreeList(Buffer_pool_mgmt *mgmt)
+{
+    // Caller holds the pool exclusively, after frames were added, released or unmapped.
+    // Lower frames end up on top of the stack and are taken first
+    if (mgmt->freeCapacity < mgmt->numFrames) {
+        int *freeFrames = realloc(mgmt->freeFrames, mgmt->numFrames * sizeof(int));
+        if (freeFrames != NULL) {
+            mgmt->freeFrames = freeFrames;
+            mgmt->freeCapacity = mgmt->numFrames;
+        }
+    }
+    mgmt->freeCount = 0;
+    for (int i = mgmt->numFrames - 1; i >= 0; i--) {
+        Buffer_page_info *frameInfo = &mgmt->pageInfos[i];
+        frameInfo->evicting = FALSE;
+        frameInfo->onFreeList = (ATOMIC_LOAD(&frameInfo->pagenums) == NO_PAGE && ATOMIC_LOAD(&frameInfo->fixcounts) == 0
+                                 && mgmt->freeCount < mgmt->freeCapacity);
+        if (frameInfo->onFreeList) {
+            mgmt->freeFrames[mgmt->freeCount++] = i;
+        }
+    }
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int findReplace(Buffer_pool_mgmt *mgmt)
+{
+    // Caller holds replLatch; the policy may still pick a frame that gets pinned before
+    // claimFrame, which then makes getVictimFrame ask again. Pages hinted EVICT_SOON go
+    // before the policy is asked, pages hinted KEEP only when it finds nothing else
+    if (ATOMIC_LOAD(&mgmt->evictSoonFrames) > 0) {
+        for (int i = 0; i < mgmt->numFrames; i++) {
+            if (ATOMIC_LOAD(&mgmt->pageInfos[i].hint) == BM_HINT_EVICT_SOON && frameEvictable(mgmt, i)) {
+                return i;
+            }
+        }
+    }
+    mgmt->sparingKept = (ATOMIC_LOAD(&mgmt->keptFrames) > 0);
+    int frame = mgmt->policy->choose_victim(mgmt->policyState, mgmt->numFrames, frameEvictable, mgmt);
+    if (frame < 0 && mgmt->sparingKept) {
+        mgmt->sparingKept = FALSE;
+        frame = mgmt->policy->choose_victim(mgmt->policyState, mgmt->numFrames, frameEvictable, mgmt);
+    }
+    mgmt->sparingKept = FALSE;
+    return (frame >= 0 && frame < mgmt->numFrames) ? frame : -1;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+// Built-in policies keep one key per frame and evict the evictable frame with the
+// lowest key: FIFO and LFU count the loads into a frame, LRU stamps every reference.
+// Hooks for different frames run concurrently with choose_victim, so keys are atomic
+typedef struct Builtin_policy_state
+{
+    long long *keys;
+    int numFrames;
+} Builtin_policy_state;
+
+static void *builtinCreate(int numFrames, void *config)
+{
+    (void)config;
+    Builtin_policy_state *state = malloc(sizeof(Builtin_policy_state));
+    if (state == NULL) {
+        return NULL;
+    }
+    state->keys = calloc(numFrames, sizeof(long long));
+    if (state->keys == NULL) {
+        free(state);
+        return NULL;
+    }
+    state->numFrames = numFrames;
+    return state;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void builtinDestroy(void *state)
+{
+    Builtin_policy_state *builtin = state;
+    free(builtin->keys);
+    free(builtin);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int builtinResize(void *state, int numFrames)
+{
+    // Shrinking keeps the larger array; the frames past numFrames are never asked about
+    Builtin_policy_state *builtin = state;
+    if (numFrames <= builtin->numFrames) {
+        return 1;
+    }
+    long long *keys = realloc(builtin->keys, numFrames * sizeof(long long));
+    if (keys == NULL) {
+        return 0;
+    }
+    memset(keys + builtin->numFrames, 0, (numFrames - builtin->numFrames) * sizeof(long long));
+    builtin->keys = keys;
+    builtin->numFrames = numFrames;
+    return 1;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void countLoad(void *state, int frame, PageNumber pageNum)
+{
+    (void)pageNum;
+    __atomic_add_fetch(&((Builtin_policy_state *)state)->keys[frame], 1, __ATOMIC_RELAXED);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void stampLoad(void *state, int frame, PageNumber pageNum)
+{
+    (void)pageNum;
+    __atomic_store_n(&((Builtin_policy_state *)state)->keys[frame], __atomic_fetch_add(&time_uni, 1, __ATOMIC_RELAXED),
+                     __ATOMIC_RELAXED);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void stampReference(void *state, int frame)
+{
+    __atomic_store_n(&((Builtin_policy_state *)state)->keys[frame], __atomic_fetch_add(&time_uni, 1, __ATOMIC_RELAXED),
+                     __ATOMIC_RELAXED);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int lowestKeyVictim(void *state, int numFrames, bool (*evictable)(const void *pool, int frame), const void *pool)
+{
+    Builtin_policy_state *builtin = state;
+    int victim = -1;
+    long long victimKey = 0;
+    for (int i = 0; i < numFrames; i++) {
+        if (!evictable(pool, i)) {
+            continue;
+        }
+        long long key = __atomic_load_n(&builtin->keys[i], __ATOMIC_RELAXED);
+        if (victim < 0 || key < victimKey) {
+            victim = i;
+            victimKey = key;
+        }
+    }
+    return victim;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static long long builtinRank(void *state, int frame)
+{
+    return __atomic_load_n(&((Builtin_policy_state *)state)->keys[frame], __ATOMIC_RELAXED);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static const BM_ReplacementPolicy fifoPolicy = {
+    "FIFO", builtinCreate, builtinDestroy, builtinResize, countLoad, NULL, NULL, NULL, lowestKeyVictim, builtinRank, NULL
+};
+static const BM_ReplacementPolicy lruPolicy = {
+    "LRU", builtinCreate, builtinDestroy, builtinResize, stampLoad, stampReference, NULL, NULL, lowestKeyVictim, builtinRank, NULL
+};
+static const BM_ReplacementPolicy lfuPolicy = {
+    "LFU", builtinCreate, builtinDestroy, builtinResize, countLoad, NULL, NULL, NULL, lowestKeyVictim, builtinRank, NULL
+};
+
+static const BM_ReplacementPolicy *builtinPolicy(ReplacementStrategy strategy)
+{
+    switch (strategy) {
+        case RS_FIFO: return &fifoPolicy;
+        case RS_LRU:  return &lruPolicy;
+        case RS_LFU:  return &lfuPolicy;
+        default:      return NULL;  // CLOCK and LRU-K only use free frames
+    }
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+BM_AccessRing *createAccessRing(BM_BufferPool *const bm, int ringSize)
+{
+    // A ring may never take more than a quarter of the pool, otherwise the
+    // scan would still push out the working set it is meant to protect
+    int maxRing = bm->numPages / 4;
+    if (ringSize > maxRing) {
+        ringSize = maxRing;
+    }
+    if (ringSize < 1) {
+        ringSize = 1;
+    }
+
+    BM_AccessRing *ring = malloc(sizeof(BM_AccessRing));
+    if (ring == NULL) {
+        return NULL;
+    }
+
+    ring->frames = calloc(ringSize, sizeof(int));
+    ring->pages = calloc(ringSize, sizeof(PageNumber));
+    if (ring->frames == NULL || ring->pages == NULL) {
+        free(ring->frames);
+        free(ring->pages);
+        free(ring);
+        return NULL;
+    }
+
+    ring->size = ringSize;
+    ring->used = 0;
+    ring->current = 0;
+    return ring;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+void freeAccessRing(BM_AccessRing *ring)
+{
+    if (ring != NULL) {
+        free(ring->frames);
+        free(ring->pages);
+        free(ring);
+    }
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC pinPageRing(BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber pageNum, BM_AccessRing *ring)
+{
+    if (ring == NULL) {
+        return pinPage(bm, page, pageNum);
+    }
+
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        clearHandle(page);
+        return RC_BUFFER_POOL_NOT_FOUND;
+    }
+
+    Buffer_pool_mgmt *mgmt = entryBP->pool_mgmt;
+    long long startNs = nowNs();
+    POOL_SHARED(mgmt);
+    RC status = pinPageRingLocked(bm, entryBP, page, pageNum, ring, startNs);
+    POOL_RELEASE(mgmt);
+    if (status != RC_OK) {
+        clearHandle(page);
+    }
+    return status;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC pinPageRingLocked(BM_BufferPool *const bm, BufferPool_Entry *entryBP, BM_PageHandle *const page, const PageNumber pageNum, BM_AccessRing *ring, long long startNs)
+{
+    Buffer_pool_mgmt *mgmt = entryBP->pool_mgmt;
+
+    for (;;) {
+        // A resident page is served from wherever it lives, the ring is only
+        // consulted on a miss
+        RC status = pinResident(entryBP, page, pageNum);
+        if (status != RC_PAGE_NOT_FOUND) {
+            if (status == RC_OK) {
+                notePinned(entryBP, pageNum, startNs, TRUE);
+            }
+            return status;
+        }
+
+        int frame = -1;
+        if (ring->used == ring->size) {
+            // Recycle the ring's oldest frame unless someone still holds it or the
+            // pool has meanwhile handed it to another page
+            int candidate = ring->frames[ring->current];
+            if (candidate < mgmt->numFrames) {
+                int claim;
+                pthread_mutex_lock(&mgmt->replLatch);
+                while ((claim = claimFrame(entryBP, candidate, ring->pages[ring->current])) == CLAIM_FLUSHED)
+                    ;
+                pthread_mutex_unlock(&mgmt->replLatch);
+                if (claim == CLAIM_OK) {
+                    frame = candidate;
+                    STAT_ADD(entryBP, ringRecycles, 1);
+                }
+            }
+        }
+
+        if (frame < 0) {
+            // Ring still filling up (or its slot is pinned): borrow a frame from the pool
+            status = getVictimFrame(bm, entryBP, &frame, TRUE, NO_PAGE);
+            if (status != RC_OK) {
+                return status;
+            }
+            if (ring->used < ring->size) {
+                ring->current = ring->used++;
+            }
+            ring->frames[ring->current] = frame;
+        }
+
+        status = loadPageIntoFrame(entryBP, frame, page, pageNum, FALSE);
+        if (status == RC_PAGE_NOT_FOUND) {
+            continue;  // page appeared meanwhile, the frame went back to the pool
+        }
+        if (status == RC_OK) {
+            ring->pages[ring->current] = pageNum;
+            ring->current = (ring->current + 1) % ring->size;
+            notePinned(entryBP, pageNum, startNs, FALSE);
+        }
+        return status;
+    }
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC beginOptimisticRead(BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber pageNum)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;
+    }
+
+    // The resize latch stays held until validateOptimisticRead, so the frame cannot go away
+    Buffer_pool_mgmt *mgmt = entryBP->pool_mgmt;
+    POOL_SHARED(mgmt);
+
+    // Walk the bucket without its stripe latch; a chain changing under us can at worst
+    // send us to a wrong frame, which the checks below reject
+    int frame = __atomic_load_n(&mgmt->buckets[BUCKET_OF(mgmt, entryBP->fileHandle, pageNum)], __ATOMIC_ACQUIRE);
+    for (int steps = 0; frame >= 0 && steps < mgmt->numFrames; steps++) {
+        Buffer_page_info *frameInfo = &mgmt->pageInfos[frame];
+        if (ATOMIC_LOAD(&frameInfo->pagenums) == pageNum && ATOMIC_LOAD(&frameInfo->file) == entryBP->fileHandle) {
+            break;
+        }
+        frame = __atomic_load_n(&frameInfo->hashNext, __ATOMIC_ACQUIRE);
+    }
+    if (frame < 0 || frame >= mgmt->numFrames) {
+        POOL_RELEASE(mgmt);
+        return RC_PAGE_NOT_FOUND;
+    }
+
+    // Version first: anything that changes the frame afterwards also changes the version
+    Buffer_page_info *frameInfo = &mgmt->pageInfos[frame];
+    unsigned int version = ATOMIC_LOAD(&frameInfo->version);
+    if (ATOMIC_LOAD(&frameInfo->fixcounts) > 0 || ATOMIC_LOAD(&frameInfo->ioInProgress)
+        || ATOMIC_LOAD(&frameInfo->pagenums) != pageNum || ATOMIC_LOAD(&frameInfo->file) != entryBP->fileHandle) {
+        // Pinned pages may be written by their pinner
+        POOL_RELEASE(mgmt);
+        STAT_ADD(entryBP, optimisticFailures, 1);
+        return RC_OPTIMISTIC_READ_FAILED;
+    }
+
+    // Count the read as a reference now and then, so read-mostly pages do not look cold to LRU
+    long long now = __atomic_load_n(&time_uni, __ATOMIC_RELAXED);
+    if (now - ATOMIC_LOAD(&frameInfo->timeStamp) > mgmt->numFrames / 2) {
+        ATOMIC_STORE(&frameInfo->timeStamp, __atomic_fetch_add(&time_uni, 1, __ATOMIC_RELAXED));
+        POLICY_HOOK(mgmt, on_pin, frame);
+    }
+
+    page->pageNum = pageNum;
+    page->data = frameInfo->pageframes;
+    page->frame = frame;
+    page->generation = frameInfo->generation;
+    page->version = version;
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+bool validateOptimisticRead(BM_BufferPool *const bm, BM_PageHandle *const page)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        return FALSE;
+    }
+
+    // Order the caller's reads of the frame before the version check
+    Buffer_pool_mgmt *mgmt = entryBP->pool_mgmt;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    bool unchanged = (ATOMIC_LOAD(&mgmt->pageInfos[page->frame].version) == page->version);
+    POOL_RELEASE(mgmt);
+    if (unchanged) {
+        STAT_ADD(entryBP, optimisticReads, 1);
+    } else {
+        STAT_ADD(entryBP, optimisticFailures, 1);
+    }
+    return unchanged;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC readPageOptimistic(BM_BufferPool *const bm, const PageNumber pageNum, int offset, int length, char *dest)
+{
+    if (offset < 0 || length < 0 || offset + length > PAGE_SIZE) {
+        return RC_OUT_OF_BOUNDS;
+    }
+
+    // Copies part of a resident page; callers fall back to pinPage on failure
+    for (int attempt = 0; attempt < OPTIMISTIC_READ_RETRIES; attempt++) {
+        BM_PageHandle page;
+        RC status = beginOptimisticRead(bm, &page, pageNum);
+        if (status != RC_OK) {
+            return status;
+        }
+        memcpy(dest, page.data + offset, length);
+        if (validateOptimisticRead(bm, &page)) {
+            return RC_OK;
+        }
+    }
+    return RC_OPTIMISTIC_READ_FAILED;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static long long victimRank(Buffer_pool_mgmt *mgmt, int frame)
+{
+    // Lower rank means closer to eviction under the frames' policy; the last
+    // reference stands in for policies that cannot rank
+    if (mgmt->policy != NULL && mgmt->policy->rank != NULL) {
+        return mgmt->policy->rank(mgmt->policyState, frame);
+    }
+    return ATOMIC_LOAD(&mgmt->pageInfos[frame].timeStamp);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+typedef struct Writer_candidate
+{
+    long long rank;
+    int frame;
+} Writer_candidate;
+
+static int compareCandidates(const void *a, const void *b)
+{
+    long long ra = ((const Writer_candidate *)a)->rank;
+    long long rb = ((const Writer_candidate *)b)->rank;
+    return (ra > rb) - (ra < rb);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int cleanNearVictims(BufferPool_Entry *entry_bp)
+{
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+    int numCandidates = 0;
+    int written = 0;
+
+    // The pool may be resized between rounds, so the candidate list is sized per round
+    POOL_SHARED(mgmt);
+    Buffer_page_info *pageInfo = mgmt->pageInfos;
+    Writer_candidate *candidates = malloc(mgmt->numFrames * sizeof(Writer_candidate));
+    if (candidates == NULL) {
+        POOL_RELEASE(mgmt);
+        return 0;
+    }
+
+    // Rank every unpinned resident frame the way the replacement strategy would
+    for (int i = 0; i < mgmt->numFrames; i++) {
+        if (ATOMIC_LOAD(&pageInfo[i].pagenums) != NO_PAGE && !ATOMIC_LOAD(&pageInfo[i].ioInProgress)
+            && ATOMIC_LOAD(&pageInfo[i].fixcounts) == 0) {
+            candidates[numCandidates].rank = victimRank(mgmt, i);
+            candidates[numCandidates].frame = i;
+            numCandidates++;
+        }
+    }
+    qsort(candidates, numCandidates, sizeof(Writer_candidate), compareCandidates);
+
+    // Only the next few victims matter, the rest will probably be re-dirtied before eviction
+    if (numCandidates > mgmt->writerLookahead) {
+        numCandidates = mgmt->writerLookahead;
+    }
+    for (int i = 0; i < numCandidates && written < mgmt->writerMaxPages; i++) {
+        if (ATOMIC_LOAD(&pageInfo[candidates[i].frame].isdirty) && flushUnpinnedFrame(entry_bp, candidates[i].frame) == RC_OK) {
+            written++;
+        }
+    }
+
+    free(candidates);
+    POOL_RELEASE(mgmt);
+    return written;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void *backgroundWriter(void *arg)
+{
+    BufferPool_Entry *entry_bp = arg;
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+
+    pthread_mutex_lock(&mgmt->writerLatch);
+    while (mgmt->writerRunning) {
+        struct timespec wakeup;
+        clock_gettime(CLOCK_REALTIME, &wakeup);
+        wakeup.tv_sec += mgmt->writerIntervalMs / 1000;
+        wakeup.tv_nsec += (long)(mgmt->writerIntervalMs % 1000) * 1000000L;
+        if (wakeup.tv_nsec >= 1000000000L) {
+            wakeup.tv_sec++;
+            wakeup.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&mgmt->writerWake, &mgmt->writerLatch, &wakeup);
+        if (!mgmt->writerRunning) {
+            break;
+        }
+
+        pthread_mutex_unlock(&mgmt->writerLatch);
+        cleanNearVictims(entry_bp);
+        pthread_mutex_lock(&mgmt->writerLatch);
+    }
+    pthread_mutex_unlock(&mgmt->writerLatch);
+    return NULL;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC startBackgroundWriter(BM_BufferPool *const bm, int intervalMs, int maxPagesPerRound)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;
+    }
+    if (intervalMs <= 0 || maxPagesPerRound <= 0) {
+        return RC_ERR;
+    }
+
+    // Checked and started under writerLatch, so pools sharing the file cannot both start one
+    Buffer_pool_mgmt *mgmt = entryBP->pool_mgmt;
+    pthread_mutex_lock(&mgmt->writerLatch);
+    if (mgmt->writerRunning) {
+        pthread_mutex_unlock(&mgmt->writerLatch);
+        return RC_ERR;  // one writer per page file
+    }
+
+    mgmt->writerIntervalMs = intervalMs;
+    mgmt->writerMaxPages = maxPagesPerRound;
+    mgmt->writerLookahead = mgmt->numFrames / 4;
+    if (mgmt->writerLookahead < 2 * maxPagesPerRound) {
+        mgmt->writerLookahead = 2 * maxPagesPerRound;
+    }
+    mgmt->writerOwner = entryBP;
+    mgmt->writerRunning = TRUE;
+
+    RC status = RC_OK;
+    if (pthread_create(&mgmt->writerThread, NULL, backgroundWriter, entryBP) != 0) {
+        mgmt->writerRunning = FALSE;
+        mgmt->writerOwner = NULL;
+        status = RC_ERR;
+    }
+    pthread_mutex_unlock(&mgmt->writerLatch);
+    return status;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void stopWriterThread(Buffer_pool_mgmt *mgmt)
+{
+    // The thread is taken under the latch: a writer started right after may reuse writerThread
+    pthread_mutex_lock(&mgmt->writerLatch);
+    bool running = mgmt->writerRunning;
+    pthread_t thread = mgmt->writerThread;
+    mgmt->writerRunning = FALSE;
+    mgmt->writerOwner = NULL;
+    pthread_cond_signal(&mgmt->writerWake);
+    pthread_mutex_unlock(&mgmt->writerLatch);
+
+    if (running) {
+        pthread_join(thread, NULL);
+    }
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC stopBackgroundWriter(BM_BufferPool *const bm)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;
+    }
+
+    stopWriterThread(entryBP->pool_mgmt);
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void prefetchOne(BufferPool_Entry *entry_bp, PageNumber pageNum)
+{
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+
+    // A prefetch is only a hint: it never grows the file past the pages pinNewPage handed out
+    if (pageNum < 0 || pageNum >= filePages(entry_bp->fileHandle)) {
+        return;
+    }
+
+    POOL_SHARED(mgmt);
+    PageTable_Stripe *stripe = STRIPE_OF(mgmt, entry_bp->fileHandle, pageNum);
+    pthread_mutex_lock(&stripe->latch);
+    int resident = lookupFrame(mgmt, entry_bp->fileHandle, pageNum);
+    pthread_mutex_unlock(&stripe->latch);
+
+    int frame;
+    BM_PageHandle page;
+    // A full pool of pinned frames simply drops the hint
+    if (resident < 0 && getVictimFrame(entry_bp->buffer_pool_ptr, entry_bp, &frame, FALSE, NO_PAGE) == RC_OK
+        && loadPageIntoFrame(entry_bp, frame, &page, pageNum, TRUE) == RC_OK) {
+        // Loaded pages stay resident but unpinned
+        STAT_ADD(entry_bp, prefetchLoads, 1);
+        unfixFrame(mgmt, frame);
+    }
+    POOL_RELEASE(mgmt);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void *prefetchWorker(void *arg)
+{
+    Buffer_pool_mgmt *mgmt = arg;
+
+    pthread_mutex_lock(&mgmt->prefetchLatch);
+    for (;;) {
+        while (mgmt->prefetchRunning && mgmt->prefetchCount == 0) {
+            pthread_cond_wait(&mgmt->prefetchWake, &mgmt->prefetchLatch);
+        }
+        if (!mgmt->prefetchRunning) {
+            break;
+        }
+
+        Prefetch_request request = mgmt->prefetchQueue[mgmt->prefetchHead];
+        mgmt->prefetchHead = (mgmt->prefetchHead + 1) % mgmt->prefetchCapacity;
+        mgmt->prefetchCount--;
+        mgmt->prefetchActive = request.entry;
+        pthread_mutex_unlock(&mgmt->prefetchLatch);
+
+        prefetchOne(request.entry, request.pageNum);
+
+        pthread_mutex_lock(&mgmt->prefetchLatch);
+        mgmt->prefetchActive = NULL;
+        pthread_cond_broadcast(&mgmt->prefetchIdle);
+    }
+    pthread_mutex_unlock(&mgmt->prefetchLatch);
+    return NULL;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC prefetchPages(BM_BufferPool *const bm, const PageNumber *pageNums, int numPages)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;
+    }
+
+    Buffer_pool_mgmt *mgmt = entryBP->pool_mgmt;
+
+    pthread_mutex_lock(&mgmt->prefetchLatch);
+    if (mgmt->prefetchQueue == NULL) {
+        mgmt->prefetchCapacity = mgmt->numFrames;
+        mgmt->prefetchQueue = malloc(mgmt->prefetchCapacity * sizeof(Prefetch_request));
+        if (mgmt->prefetchQueue == NULL) {
+            pthread_mutex_unlock(&mgmt->prefetchLatch);
+            return RC_MEMORY_ALLOCATION_FAIL;
+        }
+    }
+    if (!mgmt->prefetchRunning) {
+        mgmt->prefetchRunning = TRUE;
+        if (pthread_create(&mgmt->prefetchThread, NULL, prefetchWorker, mgmt) != 0) {
+            mgmt->prefetchRunning = FALSE;
+            pthread_mutex_unlock(&mgmt->prefetchLatch);
+            return RC_ERR;
+        }
+    }
+
+    // Requests beyond the queue's capacity are dropped, they would only evict each other
+    for (int i = 0; i < numPages && mgmt->prefetchCount < mgmt->prefetchCapacity; i++) {
+        int tail = (mgmt->prefetchHead + mgmt->prefetchCount) % mgmt->prefetchCapacity;
+        mgmt->prefetchQueue[tail].entry = entryBP;
+        mgmt->prefetchQueue[tail].pageNum = pageNums[i];
+        mgmt->prefetchCount++;
+    }
+    pthread_cond_signal(&mgmt->prefetchWake);
+    pthread_mutex_unlock(&mgmt->prefetchLatch);
+
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC prefetchPage(BM_BufferPool *const bm, const PageNumber pageNum)
+{
+    return prefetchPages(bm, &pageNum, 1);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void cancelPrefetches(Buffer_pool_mgmt *mgmt, BufferPool_Entry *entry_bp)
+{
+    // Drop the pool's queued requests and wait for the one in flight
+    pthread_mutex_lock(&mgmt->prefetchLatch);
+    int kept = 0;
+    for (int i = 0; i < mgmt->prefetchCount; i++) {
+        Prefetch_request request = mgmt->prefetchQueue[(mgmt->prefetchHead + i) % mgmt->prefetchCapacity];
+        if (request.entry != entry_bp) {
+            mgmt->prefetchQueue[(mgmt->prefetchHead + kept) % mgmt->prefetchCapacity] = request;
+            kept++;
+        }
+    }
+    mgmt->prefetchCount = kept;
+    while (mgmt->prefetchActive == entry_bp) {
+        pthread_cond_wait(&mgmt->prefetchIdle, &mgmt->prefetchLatch);
+    }
+    pthread_mutex_unlock(&mgmt->prefetchLatch);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void stopPrefetchThread(Buffer_pool_mgmt *mgmt)
+{
+    pthread_mutex_lock(&mgmt->prefetchLatch);
+    bool running = mgmt->prefetchRunning;
+    mgmt->prefetchRunning = FALSE;
+    pthread_cond_signal(&mgmt->prefetchWake);
+    pthread_mutex_unlock(&mgmt->prefetchLatch);
+
+    if (running) {
+        pthread_join(mgmt->prefetchThread, NULL);
+    }
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+typedef struct Warm_page
+{
+    PageNumber pageNum;
+    int pad;
+    long long heat;    // last reference to the page: higher is hotter
+} Warm_page;
+
+static char *warmDumpName(SM_FileHandle *fileHandle)
+{
+    char *name = malloc(strlen(fileHandle->fileName) + sizeof(".warm"));
+    if (name != NULL) {
+        sprintf(name, "%s.warm", fileHandle->fileName);
+    }
+    return name;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC writeWarmDump(BufferPool_Entry *entry_bp)
+{
+    // Caller holds the resize latch. The dump goes to a temporary file first so a
+    // crash mid-write leaves the previous dump intact
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+    char *name = warmDumpName(entry_bp->fileHandle);
+    Warm_page *pages = malloc(mgmt->numFrames * sizeof(Warm_page));
+    char *tmpName = (name != NULL) ? malloc(strlen(name) + sizeof(".tmp")) : NULL;
+    if (name == NULL || pages == NULL || tmpName == NULL) {
+        free(name);
+        free(pages);
+        free(tmpName);
+        return RC_MEMORY_ALLOCATION_FAIL;
+    }
+    sprintf(tmpName, "%s.tmp", name);
+
+    int count = 0;
+    for (int i = 0; i < mgmt->numFrames; i++) {
+        Buffer_page_info *frameInfo = &mgmt->pageInfos[i];
+        PageNumber pageNum = ATOMIC_LOAD(&frameInfo->pagenums);
+        if (pageNum != NO_PAGE && ATOMIC_LOAD(&frameInfo->file) == entry_bp->fileHandle) {
+            memset(&pages[count], 0, sizeof(Warm_page));
+            pages[count].pageNum = pageNum;
+            // Not victimRank: FIFO and LFU rank frames by their loads, whatever page they hold now
+            pages[count++].heat = ATOMIC_LOAD(&frameInfo->timeStamp);
+        }
+    }
+
+    RC status = RC_WRITE_FAILED;
+    FILE *dump = fopen(tmpName, "wb");
+    if (dump != NULL) {
+        int header[2] = {WARM_DUMP_MAGIC, count};
+        bool written = fwrite(header, sizeof(header), 1, dump) == 1
+                       && (count == 0 || fwrite(pages, sizeof(Warm_page), count, dump) == (size_t)count);
+        if (fclose(dump) == 0 && written && rename(tmpName, name) == 0) {
+            status = RC_OK;
+        } else {
+            remove(tmpName);
+        }
+    }
+
+    free(pages);
+    free(tmpName);
+    free(name);
+    return status;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC saveResidentPages(BM_BufferPool *const bm)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;
+    }
+
+    POOL_SHARED(entryBP->pool_mgmt);
+    RC status = writeWarmDump(entryBP);
+    POOL_RELEASE(entryBP->pool_mgmt);
+    return status;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int compareWarmHeat(const void *a, const void *b)
+{
+    long long ha = ((const Warm_page *)a)->heat;
+    long long hb = ((const Warm_page *)b)->heat;
+    return (ha < hb) - (ha > hb);  // hottest first
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int compareWarmPages(const void *a, const void *b)
+{
+    PageNumber pa = ((const Warm_page *)a)->pageNum;
+    PageNumber pb = ((const Warm_page *)b)->pageNum;
+    return (pa > pb) - (pa < pb);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC enableWarmRestart(BM_BufferPool *const bm)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;
+    }
+    entryBP->warmRestart = TRUE;
+
+    char *name = warmDumpName(entryBP->fileHandle);
+    if (name == NULL) {
+        return RC_MEMORY_ALLOCATION_FAIL;
+    }
+    FILE *dump = fopen(name, "rb");
+    free(name);
+    if (dump == NULL) {
+        return RC_OK;  // Nothing saved yet: start cold
+    }
+
+    // A damaged or foreign dump is ignored the same way
+    int header[2];
+    Warm_page *pages = NULL;
+    int count = 0;
+    if (fread(header, sizeof(header), 1, dump) == 1 && header[0] == WARM_DUMP_MAGIC && header[1] > 0) {
+        pages = malloc(header[1] * sizeof(Warm_page));
+        if (pages != NULL && fread(pages, sizeof(Warm_page), header[1], dump) == (size_t)header[1]) {
+            count = header[1];
+        }
+    }
+    fclose(dump);
+    if (count == 0) {
+        free(pages);
+        return RC_OK;
+    }
+
+    // Keep the hottest pages that fit, then read them in page order so the
+    // reload is one sequential pass over the file
+    if (count > bm->numPages) {
+        qsort(pages, count, sizeof(Warm_page), compareWarmHeat);
+        count = bm->numPages;
+    }
+    qsort(pages, count, sizeof(Warm_page), compareWarmPages);
+
+    PageNumber *pageNums = malloc(count * sizeof(PageNumber));
+    if (pageNums == NULL) {
+        free(pages);
+        return RC_MEMORY_ALLOCATION_FAIL;
+    }
+    for (int i = 0; i < count; i++) {
+        pageNums[i] = pages[i].pageNum;
+    }
+    free(pages);
+
+    // The prefetch thread does the reads, so the pool serves pins meanwhile
+    RC status = prefetchPages(bm, pageNums, count);
+    free(pageNums);
+    return status;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC setPinWait(BM_BufferPool *const bm, int timeoutMs)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;
+    }
+    if (timeoutMs < BM_PIN_WAIT_FOREVER) {
+        return RC_ERR;
+    }
+    // Read by each pin as it starts; pins already waiting keep their deadline
+    ATOMIC_STORE(&entryBP->pinWaitMs, timeoutMs);
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC setCompressedCache(BM_BufferPool *const bm, long capacityBytes)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;
+    }
+    if (capacityBytes < 0) {
+        return RC_ERR;
+    }
+
+    Compressed_cache *tier = NULL;
+    if (capacityBytes > 0) {
+        tier = createCompressedCache((size_t)capacityBytes);
+        if (tier == NULL) {
+            return RC_MEMORY_ALLOCATION_FAIL;
+        }
+    }
+
+    // Evictions and misses use the tier under the shared latch, so swap it exclusively
+    Buffer_pool_mgmt *mgmt = entryBP->pool_mgmt;
+    POOL_EXCLUSIVE(mgmt);
+    Compressed_cache *old = mgmt->tier;
+    mgmt->tier = tier;
+    POOL_RELEASE(mgmt);
+    destroyCompressedCache(old);
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC setAdmissionFilter(BM_BufferPool *const bm, bool enabled)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;
+    }
+
+    // Pins count into the sketch under the shared latch, so swap it exclusively
+    Buffer_pool_mgmt *mgmt = entryBP->pool_mgmt;
+    POOL_EXCLUSIVE(mgmt);
+    Frequency_sketch *old = mgmt->admission;
+    Frequency_sketch *sketch = NULL;
+    if (enabled) {
+        if (old != NULL) {
+            POOL_RELEASE(mgmt);
+            return RC_OK;
+        }
+        sketch = createFrequencySketch(mgmt->numFrames);
+        if (sketch == NULL) {
+            POOL_RELEASE(mgmt);
+            return RC_MEMORY_ALLOCATION_FAIL;
+        }
+    }
+    mgmt->admission = sketch;
+    for (int i = 0; i < mgmt->numFrames; i++) {
+        mgmt->pageInfos[i].transient = FALSE;
+    }
+    POOL_RELEASE(mgmt);
+    destroyFrequencySketch(old);
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC resizeBufferPool(BM_BufferPool *const bm, const int newNumPages)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;
+    }
+    if (newNumPages <= 0) {
+        return RC_POOL_RESIZE_FAILED;
+    }
+    return resizeFrames(entryBP, newNumPages);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC resizeFrames(BufferPool_Entry *entry_bp, int newNumFrames)
+{
+    // Pins, unpins and background work all hold the resize latch shared, so
+    // holding it exclusively leaves every frame still for the duration
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+    RC status = RC_OK;
+    POOL_EXCLUSIVE(mgmt);
+    int oldNumFrames = mgmt->numFrames;
+    if (newNumFrames > oldNumFrames) {
+        // Added frames come out of the memory budget
+        if (!reserveFrames(newNumFrames - oldNumFrames)) {
+            status = RC_MEMORY_BUDGET_EXCEEDED;
+        } else {
+            status = growPool(mgmt, newNumFrames);
+            if (mgmt->numFrames != newNumFrames) {
+                releaseFrames(newNumFrames - oldNumFrames);
+            }
+        }
+    } else if (newNumFrames < oldNumFrames) {
+        status = shrinkPool(entry_bp, newNumFrames);
+        releaseFrames(oldNumFrames - mgmt->numFrames);
+    }
+    rebuildFreeList(mgmt);
+    if (mgmt->admission != NULL && mgmt->numFrames != oldNumFrames) {
+        // A sketch sized for the old pool ages too often or too rarely, and collides into ties
+        resizeFrequencySketch(mgmt->admission, mgmt->numFrames);
+    }
+
+    if (status == RC_OK) {
+        // Every pool sharing the page file sees the new size
+        pthread_rwlock_rdlock(&entry_list_latch);
+        for (BufferPool_Entry *entry = entry_ptr_bp; entry != NULL; entry = entry->nextBufferEntry) {
+            if (entry->pool_mgmt == mgmt) {
+                ((BM_BufferPool *)entry->buffer_pool_ptr)->numPages = mgmt->numFrames;
+            }
+        }
+        pthread_rwlock_unlock(&entry_list_latch);
+    }
+    POOL_RELEASE(mgmt);
+    return status;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC setMemoryBudget(long long budgetBytes)
+{
+    if (budgetBytes < 0 || (budgetBytes > 0 && budgetBytes < PAGE_SIZE)) {
+        return RC_ERR;
+    }
+
+    // A budget below what the pools hold now shrinks the coldest ones toward their minimum
+    pthread_mutex_lock(&governor_latch);
+    ATOMIC_STORE(&governor_budget, budgetBytes / PAGE_SIZE);
+    long long excess = (budgetBytes > 0) ? ATOMIC_LOAD(&governor_frames) - budgetBytes / PAGE_SIZE : 0;
+    if (excess > 0) {
+        stealFrames((int)excess);
+    }
+    bool over = budgetBytes > 0 && ATOMIC_LOAD(&governor_frames) > budgetBytes / PAGE_SIZE;
+    pthread_mutex_unlock(&governor_latch);
+    return over ? RC_MEMORY_BUDGET_EXCEEDED : RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int compareDemand(const void *a, const void *b)
+{
+    // Hottest first
+    double da = ((const Governed_pool *)a)->demand;
+    double db = ((const Governed_pool *)b)->demand;
+    return (da < db) - (da > db);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC rebalanceBufferPools(void)
+{
+    pthread_mutex_lock(&governor_latch);
+    Governed_pool *pools;
+    int numPools = collectGovernedPools(&pools);
+    if (numPools < 0) {
+        pthread_mutex_unlock(&governor_latch);
+        return RC_MEMORY_ALLOCATION_FAIL;
+    }
+    qsort(pools, numPools, sizeof(Governed_pool), compareDemand);
+
+    // Room left in the budget goes to the pools that missed, hottest first, each at most doubling
+    long long budget = ATOMIC_LOAD(&governor_budget);
+    for (int i = 0; budget > 0 && i < numPools && pools[i].misses > 0; i++) {
+        long long room = budget - ATOMIC_LOAD(&governor_frames);
+        int frames = pools[i].mgmt->numFrames;
+        int extra = (room < frames) ? (int)room : frames;
+        if (extra <= 0) {
+            break;
+        }
+        resizeFrames(pools[i].entry, frames + extra);
+    }
+
+    // Then the coldest pools give a share of their spare frames to the hottest ones,
+    // as long as those miss clearly more often per frame
+    for (int hot = 0, cold = numPools - 1; hot < cold; hot++, cold--) {
+        if (pools[hot].misses == 0 || pools[hot].demand <= GOVERNOR_HOT_RATIO * pools[cold].demand) {
+            break;
+        }
+        int coldFrames = pools[cold].mgmt->numFrames;
+        int spare = coldFrames - pools[cold].mgmt->minFrames;
+        int moved = (spare + GOVERNOR_STEAL_SHARE - 1) / GOVERNOR_STEAL_SHARE;
+        if (moved <= 0 || resizeFrames(pools[cold].entry, coldFrames - moved) != RC_OK) {
+            continue;
+        }
+        // Should the hot pool not grow, the frames stay free in the budget
+        resizeFrames(pools[hot].entry, pools[hot].mgmt->numFrames + moved);
+    }
+
+    // The next rebalance judges the misses from here on
+    for (int i = 0; i < numPools; i++) {
+        pools[i].mgmt->governorMisses = pools[i].totalMisses;
+    }
+    free(pools);
+    pthread_mutex_unlock(&governor_latch);
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+RC getPoolBudget(BM_BufferPool *const bm, BM_PoolBudget *budget)
+{
+    BufferPool_Entry *entryBP = findEntry(bm);
+    if (entryBP == NULL) {
+        return RC_BUFFER_POOL_NOT_FOUND;
+    }
+
+    // Misses of every pool on the same frames count toward their demand
+    Buffer_pool_mgmt *mgmt = entryBP->pool_mgmt;
+    long long misses = 0;
+    pthread_rwlock_rdlock(&entry_list_latch);
+    for (BufferPool_Entry *entry = entry_ptr_bp; entry != NULL; entry = entry->nextBufferEntry) {
+        if (entry->pool_mgmt == mgmt) {
+            for (int i = 0; i < BM_STAT_SHARDS; i++) {
+                misses += __atomic_load_n(&entry->stats[i].misses, __ATOMIC_RELAXED);
+            }
+        }
+    }
+    pthread_rwlock_unlock(&entry_list_latch);
+
+    POOL_SHARED(mgmt);
+    budget->frames = mgmt->numFrames;
+    budget->minFrames = mgmt->minFrames;
+    budget->usedFrames = 0;
+    for (int i = 0; i < mgmt->numFrames; i++) {
+        if (ATOMIC_LOAD(&mgmt->pageInfos[i].pagenums) != NO_PAGE) {
+            budget->usedFrames++;
+        }
+    }
+    misses -= mgmt->governorMisses;
+    budget->demand = (misses > 0) ? (double)misses / mgmt->numFrames : 0.0;
+    POOL_RELEASE(mgmt);
+    budget->budgetFrames = ATOMIC_LOAD(&governor_budget);
+    budget->totalFrames = ATOMIC_LOAD(&governor_frames);
+    return RC_OK;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static bool reserveFrames(int numFrames)
+{
+    // Takes frames out of the budget, or fails without taking any
+    long long used = ATOMIC_LOAD(&governor_frames);
+    do {
+        long long budget = ATOMIC_LOAD(&governor_budget);
+        if (budget > 0 && used + numFrames > budget) {
+            return FALSE;
+        }
+    } while (!__atomic_compare_exchange_n(&governor_frames, &used, used + numFrames, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+    return TRUE;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void releaseFrames(int numFrames)
+{
+    __atomic_sub_fetch(&governor_frames, numFrames, __ATOMIC_ACQ_REL);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int grantFrames(int wanted)
+{
+    // Frames for a new pool: all it asks for if they fit, otherwise what is left after
+    // taking frames from colder pools; 0 when not a single frame can be had
+    if (reserveFrames(wanted)) {
+        return wanted;
+    }
+
+    pthread_mutex_lock(&governor_latch);
+    long long room = ATOMIC_LOAD(&governor_budget) - ATOMIC_LOAD(&governor_frames);
+    if (room < wanted) {
+        stealFrames((int)(wanted - room));
+    }
+    int granted = wanted;
+    while (granted > 0 && !reserveFrames(granted)) {
+        room = ATOMIC_LOAD(&governor_budget) - ATOMIC_LOAD(&governor_frames);
+        granted = (room < granted) ? (int)room : granted - 1;
+    }
+    pthread_mutex_unlock(&governor_latch);
+    return (granted > 0) ? granted : 0;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int stealFrames(int wanted)
+{
+    // Caller holds the governor latch. Shrinks the pools with the fewest misses per frame
+    // first, none below its minimum, until wanted frames are free; returns how many were
+    Governed_pool *pools;
+    int numPools = collectGovernedPools(&pools);
+    if (numPools <= 0) {
+        return 0;
+    }
+    qsort(pools, numPools, sizeof(Governed_pool), compareDemand);
+
+    int freed = 0;
+    for (int i = numPools - 1; i >= 0 && freed < wanted; i--) {
+        int frames = pools[i].mgmt->numFrames;
+        int spare = frames - pools[i].mgmt->minFrames;
+        int taken = (spare < wanted - freed) ? spare : wanted - freed;
+        // Fails while one of the released frames is pinned; the next pool is tried then
+        if (taken > 0 && resizeFrames(pools[i].entry, frames - taken) == RC_OK) {
+            freed += taken;
+        }
+    }
+    free(pools);
+    return freed;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int collectGovernedPools(Governed_pool **result)
+{
+    // Caller holds the governor latch, which keeps the pools found open; pools that are
+    // closing are left out. The global pool is only seen through the pools attached to it
+    pthread_rwlock_rdlock(&entry_list_latch);
+    int numEntries = 0;
+    for (BufferPool_Entry *entry = entry_ptr_bp; entry != NULL; entry = entry->nextBufferEntry) {
+        numEntries++;
+    }
+    Governed_pool *pools = malloc((numEntries > 0 ? numEntries : 1) * sizeof(Governed_pool));
+    if (pools == NULL) {
+        pthread_rwlock_unlock(&entry_list_latch);
+        return -1;
+    }
+
+    int numPools = 0;
+    for (BufferPool_Entry *entry = entry_ptr_bp; entry != NULL; entry = entry->nextBufferEntry) {
+        if (entry->closing) {
+            continue;
+        }
+        int p = 0;
+        while (p < numPools && pools[p].mgmt != entry->pool_mgmt) {
+            p++;
+        }
+        if (p == numPools) {
+            pools[p].entry = entry;
+            pools[p].mgmt = entry->pool_mgmt;
+            pools[p].totalMisses = 0;
+            numPools++;
+        }
+        for (int i = 0; i < BM_STAT_SHARDS; i++) {
+            pools[p].totalMisses += __atomic_load_n(&entry->stats[i].misses, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_rwlock_unlock(&entry_list_latch);
+
+    for (int p = 0; p < numPools; p++) {
+        pools[p].misses = pools[p].totalMisses - pools[p].mgmt->governorMisses;
+        if (pools[p].misses < 0) {
+            pools[p].misses = 0;  // statistics were reset meanwhile
+        }
+        pools[p].demand = (double)pools[p].misses / pools[p].mgmt->numFrames;
+    }
+    *result = pools;
+    return numPools;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC growPool(Buffer_pool_mgmt *mgmt, int newNumFrames)
+{
+    // New frames come from a fresh segment, so resident pages and the data
+    // pointers handed out for them never move
+    int extra = newNumFrames - mgmt->numFrames;
+
+    Frame_segment *segments = realloc(mgmt->segments, (mgmt->numSegments + 1) * sizeof(Frame_segment));
+    if (segments == NULL) {
+        return RC_POOL_RESIZE_FAILED;
+    }
+    mgmt->segments = segments;
+
+    Buffer_page_info *pageInfos = realloc(mgmt->pageInfos, newNumFrames * sizeof(Buffer_page_info));
+    if (pageInfos == NULL) {
+        return RC_POOL_RESIZE_FAILED;
+    }
+    mgmt->pageInfos = pageInfos;
+
+    int dirtyWords = DIRTY_WORD(newNumFrames - 1) + 1;
+    if (dirtyWords > mgmt->dirtyWords) {
+        unsigned long long *dirtyMap = realloc(mgmt->dirtyMap, dirtyWords * sizeof(unsigned long long));
+        if (dirtyMap == NULL) {
+            return RC_POOL_RESIZE_FAILED;
+        }
+        memset(dirtyMap + mgmt->dirtyWords, 0, (dirtyWords - mgmt->dirtyWords) * sizeof(unsigned long long));
+        mgmt->dirtyMap = dirtyMap;
+        mgmt->dirtyWords = dirtyWords;
+    }
+
+    if (mgmt->policy != NULL && mgmt->policy->resize != NULL
+        && !mgmt->policy->resize(mgmt->policyState, newNumFrames)) {
+        return RC_POOL_RESIZE_FAILED;
+    }
+
+    size_t segmentSize;
+    int segmentKind;
+    char *base = initFrames(extra, &segmentSize, &segmentKind);
+    if (base == NULL) {
+        return RC_FRAME_INITIALIZATION_FAILED;
+    }
+
+    Frame_segment *segment = &segments[mgmt->numSegments++];
+    segment->base = base;
+    segment->size = segmentSize;
+    segment->kind = segmentKind;
+    segment->firstFrame = mgmt->numFrames;
+    segment->numFrames = extra;
+
+    for (int i = mgmt->numFrames; i < newNumFrames; i++) {
+        memset(&pageInfos[i], 0, sizeof(Buffer_page_info));
+        pageInfos[i].pageframes = base + (size_t)(i - segment->firstFrame) * PAGE_SIZE;
+        pageInfos[i].pagenums = NO_PAGE;
+        pageInfos[i].hashNext = -1;
+    }
+    mgmt->numFrames = newNumFrames;
+
+    // Keep at least two buckets per frame
+    return rebuildPageTable(mgmt);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC shrinkPool(BufferPool_Entry *entry_bp, int newNumFrames)
+{
+    Buffer_pool_mgmt *mgmt = entry_bp->pool_mgmt;
+    Buffer_page_info *pageInfo = mgmt->pageInfos;
+    int oldNumFrames = mgmt->numFrames;
+
+    // Frames past the new size are released, so none of them may be pinned
+    for (int i = newNumFrames; i < oldNumFrames; i++) {
+        if (ATOMIC_LOAD(&pageInfo[i].fixcounts) > 0) {
+            return RC_POOL_RESIZE_FAILED;
+        }
+    }
+
+    Writer_candidate *tail = malloc((oldNumFrames - newNumFrames) * sizeof(Writer_candidate));
+    Writer_candidate *kept = malloc(newNumFrames * sizeof(Writer_candidate));
+    if (tail == NULL || kept == NULL) {
+        free(tail);
+        free(kept);
+        return RC_MEMORY_ALLOCATION_FAIL;
+    }
+
+    // Pages in released frames, and the surviving frames they could move into
+    // (free frames first, then in the order the strategy would evict them)
+    int numTail = 0;
+    int numKept = 0;
+    for (int i = newNumFrames; i < oldNumFrames; i++) {
+        if (pageInfo[i].pagenums != NO_PAGE) {
+            tail[numTail].rank = victimRank(mgmt, i);
+            tail[numTail].frame = i;
+            numTail++;
+        }
+    }
+    for (int i = 0; i < newNumFrames; i++) {
+        if (ATOMIC_LOAD(&pageInfo[i].fixcounts) == 0) {
+            kept[numKept].rank = (pageInfo[i].pagenums == NO_PAGE) ? LLONG_MIN : victimRank(mgmt, i);
+            kept[numKept].frame = i;
+            numKept++;
+        }
+    }
+    qsort(tail, numTail, sizeof(Writer_candidate), compareCandidates);
+    qsort(kept, numKept, sizeof(Writer_candidate), compareCandidates);
+
+    // Hottest released pages take the place of the coldest surviving ones; everything
+    // else is evicted, after writing it back when dirty
+    RC status = RC_OK;
+    int next = 0;
+    for (int i = numTail - 1; i >= 0 && status == RC_OK; i--) {
+        int from = tail[i].frame;
+        if (next < numKept && kept[next].rank < tail[i].rank) {
+            int to = kept[next++].frame;
+            if (pageInfo[to].pagenums != NO_PAGE && ATOMIC_LOAD(&pageInfo[to].isdirty)) {
+                status = flushFrame(entry_bp, to);
+                if (status != RC_OK) {
+                    break;
+                }
+            }
+            if (pageInfo[to].pagenums != NO_PAGE) {
+                POLICY_HOOK(mgmt, on_evict, to);
+            }
+            memcpy(pageInfo[to].pageframes, pageInfo[from].pageframes, PAGE_SIZE);
+            pageInfo[to].pagenums = pageInfo[from].pagenums;
+            pageInfo[to].file = pageInfo[from].file;
+            pageInfo[to].generation++;
+            pageInfo[to].version++;
+            ATOMIC_STORE(&pageInfo[to].isdirty, FALSE);
+            if (ATOMIC_LOAD(&pageInfo[from].isdirty)) {
+                setDirty(mgmt, to);
+            }
+            // The page brings its own admission and prefetch state, like its hint
+            pageInfo[to].transient = pageInfo[from].transient;
+            pageInfo[to].prefetched = pageInfo[from].prefetched;
+            pageInfo[to].timeStamp = pageInfo[from].timeStamp;
+            setFrameHint(mgmt, to, pageInfo[from].hint);
+            POLICY_HOOK(mgmt, on_load, to, pageInfo[to].pagenums);
+        } else if (ATOMIC_LOAD(&pageInfo[from].isdirty)) {
+            status = flushFrame(entry_bp, from);
+            if (status != RC_OK) {
+                break;
+            }
+        }
+        POLICY_HOOK(mgmt, on_evict, from);
+        setFrameHint(mgmt, from, BM_HINT_NORMAL);
+        pageInfo[from].pagenums = NO_PAGE;
+        pageInfo[from].file = NULL;
+        ATOMIC_STORE(&pageInfo[from].isdirty, FALSE);
+        pageInfo[from].transient = FALSE;
+        pageInfo[from].prefetched = FALSE;
+    }
+    free(tail);
+    free(kept);
+
+    if (status != RC_OK) {
+        // Nothing was released; re-map the pages that did move
+        rebuildPageTable(mgmt);
+        return RC_WRITE_FAILED;
+    }
+
+    // Give the released frames back: whole trailing segments are unmapped, a partly
+    // used mapped segment is trimmed at a page boundary, heap segments keep their size
+    for (int i = mgmt->numSegments - 1; i >= 0; i--) {
+        Frame_segment *segment = &mgmt->segments[i];
+        if (segment->firstFrame >= newNumFrames) {
+            freeFrames(segment->base, segment->size, segment->kind);
+            mgmt->numSegments--;
+            continue;
+        }
+        int keep = newNumFrames - segment->firstFrame;
+        if (keep < segment->numFrames) {
+            size_t keepSize = (size_t)keep * PAGE_SIZE;
+            if (segment->kind == ARENA_MMAP && keepSize % getpagesize() == 0) {
+                munmap(segment->base + keepSize, segment->size - keepSize);
+                segment->size = keepSize;
+            }
+            segment->numFrames = keep;
+        }
+        break;
+    }
+
+    Buffer_page_info *pageInfos = realloc(mgmt->pageInfos, newNumFrames * sizeof(Buffer_page_info));
+    if (pageInfos != NULL) {
+        mgmt->pageInfos = pageInfos;
+    }
+    for (int i = newNumFrames; i < mgmt->numFrames; i++) {
+        mgmt->dirtyMap[DIRTY_WORD(i)] &= ~DIRTY_BIT(i);
+    }
+    mgmt->numFrames = newNumFrames;
+    return rebuildPageTable(mgmt);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static RC rebuildPageTable(Buffer_pool_mgmt *mgmt)
+{
+    // Caller holds the resize latch exclusively; sizing matches initBufferPool
+    int numBuckets = BM_NUM_STRIPES;
+    while (numBuckets < 2 * mgmt->numFrames) {
+        numBuckets <<= 1;
+    }
+    if (numBuckets != mgmt->numBuckets) {
+        int *buckets = malloc(numBuckets * sizeof(int));
+        if (buckets != NULL) {
+            free(mgmt->buckets);
+            mgmt->buckets = buckets;
+            mgmt->numBuckets = numBuckets;
+        }
+    }
+
+    for (int i = 0; i < mgmt->numBuckets; i++) {
+        mgmt->buckets[i] = -1;
+    }
+    for (int i = 0; i < mgmt->numFrames; i++) {
+        mgmt->pageInfos[i].hashNext = -1;
+        if (mgmt->pageInfos[i].pagenums != NO_PAGE) {
+            insertFrame(mgmt, i);
+        }
+    }
+    return RC_OK;
 }
-//--------------------------------------------------------------------------------------------------------------------------------------------------s
\ No newline at end of file
+//--------------------------------------------------------------------------------------------------------------------------------------------------
@@ -28,17 +28,98 @@ typedef struct BM_BufferPool {
                   // manager needs for a buffer pool
 } BM_BufferPool;
 
+// Page latch a pin holds, see pinPageShared
+typedef enum BM_LatchMode {
+  BM_LATCH_NONE = 0,
+  BM_LATCH_SHARED = 1,
+  BM_LATCH_EXCLUSIVE = 2
+} BM_LatchMode;
+
 typedef struct BM_PageHandle {
   PageNumber pageNum;
   char *data;
+  int frame;               // frame pinPage found the page in
+  unsigned int generation; // frame generation at pin time, guards against reuse
+  unsigned int version;    // frame version an optimistic read started from
+  BM_LatchMode latchMode;  // latch taken with the pin, dropped by the unpin
 } BM_PageHandle;
 
+// Replacement policy plug-in. Pass one as stratData to initBufferPool (or
+// initGlobalBufferPool) to replace the built-in policy chosen by strategy; its
+// config is handed to create. A policy belongs to the frames it manages, so pools
+// that share frames share the policy of the pool that created them.
+// Hooks for different frames may run concurrently, choose_victim runs under the
+// pool's victim latch and returns an evictable frame or -1. Hooks left NULL are skipped
+typedef struct BM_ReplacementPolicy {
+  const char *name;
+  void *(*create) (int numFrames, void *config);     // per-policy state, NULL on failure
+  void (*destroy) (void *state);
+  int (*resize) (void *state, int numFrames);        // 0 if the state cannot grow
+  void (*on_load) (void *state, int frame, PageNumber pageNum);
+  void (*on_pin) (void *state, int frame);           // a reference to a resident page
+  void (*on_unpin) (void *state, int frame, bool dirty);
+  void (*on_evict) (void *state, int frame);
+  int (*choose_victim) (void *state, int numFrames,
+			bool (*evictable) (const void *pool, int frame), const void *pool);
+  long long (*rank) (void *state, int frame);        // lower is closer to eviction
+  void *config;
+} BM_ReplacementPolicy;
+
+// Scan-resistant access strategy: a small private ring of frames that a
+// sequential scan recycles among themselves instead of flushing the pool
+#define BM_DEFAULT_RING_SIZE 32
+
+typedef struct BM_AccessRing {
+  int size;            // number of frames the ring may hold
+  int used;            // number of ring slots filled so far
+  int current;         // next ring slot to recycle
+  int *frames;         // frame index held by each ring slot
+  PageNumber *pages;   // page the ring loaded into each slot
+} BM_AccessRing;
+
+// Snapshot of a pool's counters since initBufferPool or the last resetPoolStats
+typedef struct BM_PoolStats {
+  long long hits;               // pins served by a resident page
+  long long misses;             // pins that had to read the page
+  long long readIO;             // same count as getNumReadIO
+  long long writeIO;            // same count as getNumWriteIO
+  long long writeCalls;         // writes issued for them; a coalesced run of pages is one call
+  long long pinnedWrites;       // pages pinned by others while being copied for a write; they stay dirty
+  long long cleanEvictions;     // victims dropped without a write
+  long long dirtyEvictions;     // victims written back before eviction
+  double avgPinLatencyNs;       // pinPage and pinPageRing, hits and misses alike
+  int pinnedNow;                // pins currently held through this pool
+  int peakPinned;               // most pins held at once
+  long long prefetchLoads;      // pages read by prefetch
+  long long prefetchHits;       // prefetched pages pinned before being evicted
+  long long prefetchWasted;     // prefetched pages evicted without ever being pinned
+  long long victimSearches;     // victims picked by the replacement strategy
+  long long victimRetries;      // victims lost to a concurrent pin or write-back
+  long long ringRecycles;       // frames a scan's access ring reused
+  long long optimisticReads;    // optimistic reads that validated
+  long long optimisticFailures; // optimistic reads refused or invalidated
+  long long pinWaits;           // pins that slept because every frame was pinned
+  long long pinWaitTimeouts;    // of those, pins that gave up
+  double avgPinWaitNs;          // sleep per waiting pin
+  long long tierStores;         // evicted pages kept compressed, see setCompressedCache
+  long long tierHits;           // misses served from the compressed copies instead of the file
+  int tierPages;                // pages kept compressed now
+  long long tierBytes;          // and their compressed size
+  long long admissionRejects;   // misses the admission filter served from a transient frame
+  long long freeListRefills;    // batches of victims evicted ahead of the misses that need the frames
+  int freeFrames;               // evicted frames waiting for a miss now
+  long long latchWaits;         // page latches that had to wait for another holder
+  long long newPages;           // misses pinNewPage served with a zeroed frame instead of a read
+} BM_PoolStats;
+
 // convenience macros
 #define MAKE_POOL()					\
   ((BM_BufferPool *) malloc (sizeof(BM_BufferPool)))
 
 #define MAKE_PAGE_HANDLE()				\
-  ((BM_PageHandle *) malloc (sizeof(BM_PageHandle)))
+  ({ BM_PageHandle *_h = (BM_PageHandle *) calloc (1, sizeof(BM_PageHandle)); \
+     if (_h != NULL) { _h->frame = -1; _h->latchMode = BM_LATCH_NONE; } \
+     _h; })
 
 // Buffer Manager Interface Pool Handling
 RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName, 
@@ -46,19 +127,158 @@ RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName,
 		  void *stratData);
 RC shutdownBufferPool(BM_BufferPool *const bm);
 RC forceFlushPool(BM_BufferPool *const bm);
+RC resizeBufferPool(BM_BufferPool *const bm, const int newNumPages);
+
+// Process-wide buffer pool: one set of frames and one replacement strategy
+// shared by every pool attached to it, whatever page file it reads
+RC initGlobalBufferPool(const int numPages, ReplacementStrategy strategy, void *stratData);
+RC shutdownGlobalBufferPool(void);
+RC attachBufferPool(BM_BufferPool *const bm, const char *const pageFileName);
+bool globalBufferPoolActive(void);
 
 // Buffer Manager Interface Access Pages
 RC markDirty (BM_BufferPool *const bm, BM_PageHandle *const page);
 RC unpinPage (BM_BufferPool *const bm, BM_PageHandle *const page);
+RC unpinPageDirty (BM_BufferPool *const bm, BM_PageHandle *const page);
 RC forcePage (BM_BufferPool *const bm, BM_PageHandle *const page);
 RC pinPage (BM_BufferPool *const bm, BM_PageHandle *const page, 
 	    const PageNumber pageNum);
 
+// New pages: pinNewPage pins a zeroed page past the end of the file without
+// reading it. The page is dirty, and the file only grows when it is written
+// back; getNumFilePages counts such pages along with those in the file.
+// pinNewPageExclusive also holds the page's exclusive latch from the start
+RC pinNewPage (BM_BufferPool *const bm, BM_PageHandle *const page);
+RC pinNewPageExclusive (BM_BufferPool *const bm, BM_PageHandle *const page);
+int getNumFilePages (BM_BufferPool *const bm);
+
+// Buffer Manager Interface Access Strategies
+BM_AccessRing *createAccessRing (BM_BufferPool *const bm, int ringSize);
+void freeAccessRing (BM_AccessRing *ring);
+RC pinPageRing (BM_BufferPool *const bm, BM_PageHandle *const page, 
+		const PageNumber pageNum, BM_AccessRing *ring);
+
+// Optimistic reads: look at a resident page without pinning it. Every
+// beginOptimisticRead that succeeds must be ended by validateOptimisticRead,
+// which tells whether the page changed while it was being read
+RC beginOptimisticRead (BM_BufferPool *const bm, BM_PageHandle *const page, 
+			const PageNumber pageNum);
+bool validateOptimisticRead (BM_BufferPool *const bm, BM_PageHandle *const page);
+RC readPageOptimistic (BM_BufferPool *const bm, const PageNumber pageNum, 
+		       int offset, int length, char *dest);
+
+// Asynchronous prefetch: start reading pages into frames without pinning them;
+// a later pinPage finds them resident or waits for the read in flight
+RC prefetchPage (BM_BufferPool *const bm, const PageNumber pageNum);
+RC prefetchPages (BM_BufferPool *const bm, const PageNumber *pageNums, int numPages);
+
+// Warm restart: saveResidentPages writes the pool's resident pages and their heat to
+// "<pageFile>.warm"; enableWarmRestart reloads the hottest of them in the background
+// and has shutdownBufferPool save the set again
+RC enableWarmRestart (BM_BufferPool *const bm);
+RC saveResidentPages (BM_BufferPool *const bm);
+
+// Blocking pins: when every frame is pinned, pinPage and pinPageRing sleep until a
+// frame is unpinned instead of failing, for at most timeoutMs, then return
+// RC_PIN_WAIT_TIMEOUT. A thread waiting for frames it pins itself only wakes by timeout
+#define BM_PIN_NO_WAIT 0          // fail at once with the strategy's error (the default)
+#define BM_PIN_WAIT_FOREVER -1
+RC setPinWait (BM_BufferPool *const bm, int timeoutMs);
+
+// Memory governor: setMemoryBudget caps the frames of all pools together (0 lifts
+// the cap). A pool that does not fit takes frames from the pools with the fewest
+// misses per frame, or starts smaller than asked. rebalanceBufferPools moves frames
+// from cold pools to hot ones, judged by misses since the previous rebalance
+typedef struct BM_PoolBudget {
+  int frames;              // frames the pool holds, shared with pools on the same frames
+  int minFrames;           // the governor never shrinks it below this
+  int usedFrames;          // frames holding a page
+  double demand;           // misses per frame since the last rebalance
+  long long budgetFrames;  // frames all pools may hold together, 0 without a budget
+  long long totalFrames;   // frames all pools hold now
+} BM_PoolBudget;
+
+RC setMemoryBudget (long long budgetBytes);
+RC rebalanceBufferPools (void);
+RC getPoolBudget (BM_BufferPool *const bm, BM_PoolBudget *budget);
+
+// Compressed second cache level: clean pages evicted from the frames are kept
+// compressed in a region of capacityBytes shared by the frames' pools, and a later
+// miss decompresses them instead of reading the file. Pages that compress poorly
+// are not kept. 0 turns it off; changing the size drops what was kept
+RC setCompressedCache (BM_BufferPool *const bm, long capacityBytes);
+
+// Page latches: pinPageShared and pinPageExclusive pin a page like pinPage and also take
+// its latch, held by any number of readers or by one writer; unpinPage and unpinPageDirty
+// drop it. Plain pins neither take nor wait for latches. Readers do not hold back for a
+// waiting writer, so a thread may take a shared latch it already holds, but must not
+// latch a page it holds exclusively
+RC pinPageShared (BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber pageNum);
+RC pinPageExclusive (BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber pageNum);
+// Latches a page the handle pins without a latch, for example after pinPageRing
+RC latchPage (BM_BufferPool *const bm, BM_PageHandle *const page, BM_LatchMode mode);
+
+// Pin hints: pinPageHint pins like pinPage and tells victim selection how long the page
+// is worth keeping; setPageHint changes it for a page the handle pins. The hint stays
+// with the page until it is evicted or hinted again, except that a plain pin of an
+// EVICT_SOON page makes it NORMAL again. EVICT_SOON pages are the first victims, before
+// the policy is asked; KEEP pages are only evicted when nothing else can be
+typedef enum BM_PinHint {
+  BM_HINT_NORMAL = 0,
+  BM_HINT_KEEP = 1,        // catalog, header and index inner pages
+  BM_HINT_EVICT_SOON = 2   // pages a scan has moved past
+} BM_PinHint;
+
+RC pinPageHint (BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber pageNum, BM_PinHint hint);
+RC setPageHint (BM_BufferPool *const bm, BM_PageHandle *const page, BM_PinHint hint);
+
+// Admission filter in front of the replacement policy: every pinPage counts its page in a
+// frequency sketch of a few bytes per frame that halves its counts as they age. A miss that
+// would evict a page used more often than itself is refused: the page is still read and
+// pinned, but into a transient frame the next refused page reuses, so scans do not push
+// out the hot set. Prefetches and ring pins are always admitted
+RC setAdmissionFilter (BM_BufferPool *const bm, bool enabled);
+
+// Access tracing: while a trace is running every pinPage, pinPageRing, unpinPage,
+// unpinPageDirty and markDirty of every pool is appended to the trace file as a
+// BM_TraceRecord, after a BM_TraceHeader. bufsim replays such traces offline
+#define BM_TRACE_MAGIC 0x52544d42  // "BMTR"
+#define BM_TRACE_VERSION 1
+
+typedef enum BM_TraceOp {
+  BM_TRACE_PIN = 1,
+  BM_TRACE_UNPIN = 2,
+  BM_TRACE_DIRTY = 3
+} BM_TraceOp;
+
+typedef struct BM_TraceHeader {
+  unsigned int magic;
+  unsigned int version;
+} BM_TraceHeader;
+
+typedef struct BM_TraceRecord {
+  long long timeNs;        // since startBufferTrace
+  PageNumber pageNum;
+  unsigned short pool;     // pools are numbered in the order they were opened
+  unsigned char op;        // BM_TraceOp
+  unsigned char hit;       // pins only: the page was resident
+} BM_TraceRecord;
+
+RC startBufferTrace (const char *traceFile);
+RC stopBufferTrace (void);
+
+// Background writer: cleans dirty, unpinned frames close to eviction every
+// intervalMs, writing at most maxPagesPerRound pages per round
+RC startBackgroundWriter (BM_BufferPool *const bm, int intervalMs, int maxPagesPerRound);
+RC stopBackgroundWriter (BM_BufferPool *const bm);
+
 // Statistics Interface
 PageNumber *getFrameContents (BM_BufferPool *const bm);
 bool *getDirtyFlags (BM_BufferPool *const bm);
 int *getFixCounts (BM_BufferPool *const bm);
 int getNumReadIO (BM_BufferPool *const bm);
+RC getPoolStats (BM_BufferPool *const bm, BM_PoolStats *stats);
+RC resetPoolStats (BM_BufferPool *const bm);
 int getNumWriteIO (BM_BufferPool *const bm);
 
 #endif
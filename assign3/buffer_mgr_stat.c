@@ -50,6 +50,34 @@ sprintPoolContent (BM_BufferPool *const bm)
   return message;
 }
 
+void
+printPoolStats (BM_BufferPool *const bm)
+{
+  BM_PoolStats stats;
+  long long pins;
+
+  if (getPoolStats(bm, &stats) != RC_OK)
+    return;
+
+  pins = stats.hits + stats.misses;
+  printf("{");
+  printStrat(bm);
+  printf(" %i}: ", bm->numPages);
+  printf("hits %lld misses %lld (%.1f%% hit) reads %lld writes %lld in %lld calls (%lld pinned)\n",
+	 stats.hits, stats.misses, pins ? 100.0 * stats.hits / pins : 0.0, stats.readIO, stats.writeIO, stats.writeCalls,
+	 stats.pinnedWrites);
+  printf("  evictions clean %lld dirty %lld, pin latency %.0f ns, pinned %i (peak %i)\n",
+	 stats.cleanEvictions, stats.dirtyEvictions, stats.avgPinLatencyNs, stats.pinnedNow, stats.peakPinned);
+  printf("  prefetch loads %lld hits %lld wasted %lld, victim searches %lld retries %lld, ring recycles %lld\n",
+	 stats.prefetchLoads, stats.prefetchHits, stats.prefetchWasted, stats.victimSearches, stats.victimRetries, stats.ringRecycles);
+  printf("  optimistic reads %lld failures %lld\n", stats.optimisticReads, stats.optimisticFailures);
+  printf("  pin waits %lld timeouts %lld, wait %.0f ns\n", stats.pinWaits, stats.pinWaitTimeouts, stats.avgPinWaitNs);
+  printf("  compressed stores %lld hits %lld, holding %d pages in %lld bytes\n", stats.tierStores, stats.tierHits,
+	 stats.tierPages, stats.tierBytes);
+  printf("  admission rejects %lld, free list refills %lld, %d free frames\n", stats.admissionRejects,
+	 stats.freeListRefills, stats.freeFrames);
+  printf("  page latch waits %lld, new pages %lld\n", stats.latchWaits, stats.newPages);
+}
 
 void
 printPageContent (BM_PageHandle *const page)
@@ -0,0 +1,215 @@
+#include "storage_mgr.h"
+#include "buffer_mgr.h"
+#include "dberror.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Replays an access trace recorded with startBufferTrace against every built-in
+// replacement strategy and a range of pool sizes, on scratch copies of the traced files.
+// usage: bufsim trace.bin [frames ...]
+
+#define SIM_MAX_POOLS 65536
+#define SIM_MAX_SIZES 16
+#define SIM_DEFAULT_SIZES 8
+
+typedef struct SimPool {
+    BM_BufferPool *bm;
+    char fileName[32];
+    int numPages;        // highest traced page + 1
+    int *pins;           // pins the replay holds on each page
+} SimPool;
+
+typedef struct SimResult {
+    long long hits;
+    long long misses;
+    long long readIO;
+    long long writeIO;
+    long long failedPins;
+} SimResult;
+
+static BM_TraceRecord *readTrace (const char *fileName, long *numRecords);
+static void replay (BM_TraceRecord *records, long numRecords, SimPool *pools, int numPools,
+                    const int *poolOf, ReplacementStrategy strategy, int numFrames, SimResult *result);
+
+int
+main (int argc, char **argv)
+{
+    ReplacementStrategy strategies[] = {RS_FIFO, RS_LRU, RS_LFU};
+    const char *names[] = {"FIFO", "LRU", "LFU"};
+    int sizes[SIM_MAX_SIZES];
+    int numSizes = 0;
+    int *poolOf;
+    SimPool *pools;
+    int numPools = 0, maxPages = 0;
+    long numRecords, hits = 0, pins = 0, i;
+    BM_TraceRecord *records;
+    SM_FileHandle fh;
+    int p, s, k;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s trace [frames ...]\n", argv[0]);
+        return 1;
+    }
+    records = readTrace(argv[1], &numRecords);
+    if (records == NULL)
+    {
+        fprintf(stderr, "%s: not a buffer trace\n", argv[1]);
+        return 1;
+    }
+
+    // Number the traced pools densely and size a scratch file for each
+    poolOf = malloc(SIM_MAX_POOLS * sizeof(int));
+    pools = calloc(SIM_MAX_POOLS, sizeof(SimPool));
+    for (p = 0; p < SIM_MAX_POOLS; p++)
+        poolOf[p] = -1;
+    for (i = 0; i < numRecords; i++)
+    {
+        if (records[i].pageNum < 0)
+            continue;
+        if (poolOf[records[i].pool] < 0)
+            poolOf[records[i].pool] = numPools++;
+        p = poolOf[records[i].pool];
+        if (records[i].pageNum + 1 > pools[p].numPages)
+            pools[p].numPages = records[i].pageNum + 1;
+        if (records[i].op == BM_TRACE_PIN)
+        {
+            pins++;
+            hits += records[i].hit;
+        }
+    }
+    for (p = 0; p < numPools; p++)
+    {
+        sprintf(pools[p].fileName, "bufsim_%d.bin", p);
+        CHECK(createPageFile(pools[p].fileName));
+        CHECK(openPageFile(pools[p].fileName, &fh));
+        CHECK(ensureCapacity(pools[p].numPages, &fh));
+        CHECK(closePageFile(&fh));
+        pools[p].pins = calloc(pools[p].numPages, sizeof(int));
+        pools[p].bm = MAKE_POOL();
+        if (pools[p].numPages > maxPages)
+            maxPages = pools[p].numPages;
+    }
+
+    // Pool sizes from the command line, or doubling from 4 frames up to the largest file
+    for (k = 2; k < argc && numSizes < SIM_MAX_SIZES; k++)
+        if (atoi(argv[k]) > 0)
+            sizes[numSizes++] = atoi(argv[k]);
+    for (k = 4; numSizes == 0 || (argc <= 2 && numSizes < SIM_DEFAULT_SIZES && k < 2 * maxPages); k *= 2)
+        sizes[numSizes++] = k;
+
+    printf("# %ld records, %d pools, traced hit ratio %.4f\n", numRecords, numPools,
+           pins ? (double) hits / pins : 0.0);
+    printf("strategy,frames,hit_ratio,hits,misses,reads,writes,failed_pins\n");
+    for (k = 0; k < (int) (sizeof(strategies) / sizeof(strategies[0])); k++)
+        for (s = 0; s < numSizes; s++)
+        {
+            SimResult result;
+            replay(records, numRecords, pools, numPools, poolOf, strategies[k], sizes[s], &result);
+            printf("%s,%d,%.4f,%lld,%lld,%lld,%lld,%lld\n", names[k], sizes[s],
+                   (result.hits + result.misses) ? (double) result.hits / (result.hits + result.misses) : 0.0,
+                   result.hits, result.misses, result.readIO, result.writeIO, result.failedPins);
+        }
+
+    for (p = 0; p < numPools; p++)
+    {
+        destroyPageFile(pools[p].fileName);
+        free(pools[p].pins);
+        free(pools[p].bm);
+    }
+    free(pools);
+    free(poolOf);
+    free(records);
+    return 0;
+}
+
+// ************************************************************
+BM_TraceRecord *
+readTrace (const char *fileName, long *numRecords)
+{
+    FILE *file = fopen(fileName, "rb");
+    BM_TraceHeader header;
+    BM_TraceRecord *records = NULL;
+    long size;
+
+    if (file == NULL)
+        return NULL;
+    if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == BM_TRACE_MAGIC
+        && header.version == BM_TRACE_VERSION)
+    {
+        fseek(file, 0, SEEK_END);
+        size = ftell(file) - (long) sizeof(header);
+        fseek(file, sizeof(header), SEEK_SET);
+        *numRecords = size / (long) sizeof(BM_TraceRecord);
+        records = malloc((*numRecords > 0 ? *numRecords : 1) * sizeof(BM_TraceRecord));
+        if (records != NULL && fread(records, sizeof(BM_TraceRecord), *numRecords, file) != (size_t) *numRecords)
+        {
+            free(records);
+            records = NULL;
+        }
+    }
+    fclose(file);
+    return records;
+}
+
+void
+replay (BM_TraceRecord *records, long numRecords, SimPool *pools, int numPools,
+        const int *poolOf, ReplacementStrategy strategy, int numFrames, SimResult *result)
+{
+    BM_PageHandle h;
+    BM_PoolStats stats;
+    long i;
+    int p, page;
+
+    memset(result, 0, sizeof(SimResult));
+    for (p = 0; p < numPools; p++)
+        CHECK(initBufferPool(pools[p].bm, pools[p].fileName, numFrames, strategy, NULL));
+
+    // Unpins and dirty marks name the page only, so the handles need no frame
+    for (i = 0; i < numRecords; i++)
+    {
+        if (records[i].pageNum < 0)
+            continue;
+        p = poolOf[records[i].pool];
+        page = records[i].pageNum;
+        h.pageNum = page;
+        h.frame = -1;
+        switch (records[i].op)
+        {
+        case BM_TRACE_PIN:
+            if (pinPage(pools[p].bm, &h, page) == RC_OK)
+                pools[p].pins[page]++;
+            else
+                result->failedPins++;
+            break;
+        case BM_TRACE_DIRTY:
+            if (pools[p].pins[page] > 0)
+                markDirty(pools[p].bm, &h);
+            break;
+        case BM_TRACE_UNPIN:
+            if (pools[p].pins[page] > 0)
+            {
+                unpinPage(pools[p].bm, &h);
+                pools[p].pins[page]--;
+            }
+            break;
+        }
+    }
+
+    // Pins still open at the end of the trace are dropped so the pools can shut down
+    for (p = 0; p < numPools; p++)
+    {
+        for (page = 0; page < pools[p].numPages; page++)
+            for (h.pageNum = page, h.frame = -1; pools[p].pins[page] > 0; pools[p].pins[page]--)
+                unpinPage(pools[p].bm, &h);
+        CHECK(forceFlushPool(pools[p].bm));
+        CHECK(getPoolStats(pools[p].bm, &stats));
+        result->hits += stats.hits;
+        result->misses += stats.misses;
+        result->readIO += stats.readIO;
+        result->writeIO += stats.writeIO;
+        CHECK(shutdownBufferPool(pools[p].bm));
+    }
+}
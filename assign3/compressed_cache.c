@@ -0,0 +1,374 @@
+#include "compressed_cache.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Page codec: LZ77 sequences of (literals, match) with a one-entry-per-hash match finder.
+// Each sequence is a token byte (4 bits literal length, 4 bits match length - 4), length
+// extension bytes for nibbles of 15, the literals, then a 2-byte back offset and the match
+// extension. The last sequence holds literals only. Zero filled record pages shrink to a few bytes
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 0xFFFF
+
+// A kept page, in the order its bytes were placed in the region
+typedef struct Cached_page
+{
+    const void *file;
+    PageNumber pageNum;
+    size_t offset;          // start of the compressed bytes in the region
+    int length;
+    int hashNext;           // next entry of the same bucket, -1 ends the chain
+    bool live;              // FALSE once taken or replaced; the bytes are reclaimed in order
+} Cached_page;
+
+struct Compressed_cache
+{
+    pthread_mutex_t latch;
+    char *region;
+    size_t capacity;
+    size_t head;            // where the next page goes
+    Cached_page *entries;   // ring of entries, oldest at first
+    int maxEntries;
+    int first;
+    int count;
+    int *buckets;           // index of live entries by (file, page)
+    int numBuckets;
+    int livePages;
+    long long liveBytes;
+};
+
+static int compressPage(const unsigned char *src, int srcLen, unsigned char *dst, int dstCap);
+static int decompressPage(const unsigned char *src, int srcLen, unsigned char *dst, int dstLen);
+static bool putLength(unsigned char *dst, int *op, int dstCap, int length);
+static int findEntry(Compressed_cache *cache, const void *file, PageNumber pageNum, int **link);
+static void dropOldest(Compressed_cache *cache);
+static bool reserve(Compressed_cache *cache, int length);
+
+#define CC_BUCKET_OF(cache, file, pageNum) \
+    ((int)((((unsigned int)(pageNum) + (unsigned int)((uintptr_t)(file) >> 4)) * 2654435761u) & (unsigned int)((cache)->numBuckets - 1)))
+
+Compressed_cache *createCompressedCache(size_t capacity)
+{
+    Compressed_cache *cache = calloc(1, sizeof(Compressed_cache));
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    pthread_mutex_init(&cache->latch, NULL);
+
+    // Zero pages take a few bytes, so entries are bounded separately from the region
+    cache->capacity = capacity;
+    cache->maxEntries = (int)(capacity / 64) + 16;
+    cache->numBuckets = 16;
+    while (cache->numBuckets < cache->maxEntries) {
+        cache->numBuckets <<= 1;
+    }
+    cache->region = malloc(capacity);
+    cache->entries = malloc(cache->maxEntries * sizeof(Cached_page));
+    cache->buckets = malloc(cache->numBuckets * sizeof(int));
+    if (cache->region == NULL || cache->entries == NULL || cache->buckets == NULL) {
+        destroyCompressedCache(cache);
+        return NULL;
+    }
+    for (int i = 0; i < cache->numBuckets; i++) {
+        cache->buckets[i] = -1;
+    }
+    return cache;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+void destroyCompressedCache(Compressed_cache *cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&cache->latch);
+    free(cache->region);
+    free(cache->entries);
+    free(cache->buckets);
+    free(cache);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+int compressedCachePack(const char *page, char *packed)
+{
+    // Needs no latch: callers pack before taking theirs and store the result afterwards
+    int length = compressPage((const unsigned char *)page, PAGE_SIZE, (unsigned char *)packed, CC_MAX_STORED);
+    return (length > 0) ? length : 0;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+bool compressedCacheStore(Compressed_cache *cache, const void *file, PageNumber pageNum, const char *packed, int length)
+{
+    pthread_mutex_lock(&cache->latch);
+    int *link;
+    int old = findEntry(cache, file, pageNum, &link);
+    if (old >= 0) {
+        // The new copy supersedes the old one whether or not it is kept
+        *link = cache->entries[old].hashNext;
+        cache->entries[old].live = FALSE;
+        cache->livePages--;
+        cache->liveBytes -= cache->entries[old].length;
+    }
+    if (length <= 0 || !reserve(cache, length)) {
+        pthread_mutex_unlock(&cache->latch);
+        return FALSE;
+    }
+
+    int slot = (cache->first + cache->count) % cache->maxEntries;
+    Cached_page *entry = &cache->entries[slot];
+    entry->file = file;
+    entry->pageNum = pageNum;
+    entry->offset = cache->head;
+    entry->length = length;
+    entry->live = TRUE;
+    memcpy(cache->region + cache->head, packed, length);
+    cache->head += length;
+    cache->count++;
+
+    int bucket = CC_BUCKET_OF(cache, file, pageNum);
+    entry->hashNext = cache->buckets[bucket];
+    cache->buckets[bucket] = slot;
+    cache->livePages++;
+    cache->liveBytes += length;
+    pthread_mutex_unlock(&cache->latch);
+    return TRUE;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+bool compressedCacheTake(Compressed_cache *cache, const void *file, PageNumber pageNum, char *page)
+{
+    pthread_mutex_lock(&cache->latch);
+    int *link;
+    int slot = findEntry(cache, file, pageNum, &link);
+    if (slot < 0) {
+        pthread_mutex_unlock(&cache->latch);
+        return FALSE;
+    }
+
+    // The page goes back to the frames, so this copy is dropped either way
+    Cached_page *entry = &cache->entries[slot];
+    int length = decompressPage((const unsigned char *)cache->region + entry->offset, entry->length,
+                                (unsigned char *)page, PAGE_SIZE);
+    *link = entry->hashNext;
+    entry->live = FALSE;
+    cache->livePages--;
+    cache->liveBytes -= entry->length;
+    pthread_mutex_unlock(&cache->latch);
+    return length == PAGE_SIZE;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+void compressedCacheDropFile(Compressed_cache *cache, const void *file)
+{
+    pthread_mutex_lock(&cache->latch);
+    for (int i = 0; i < cache->count; i++) {
+        Cached_page *entry = &cache->entries[(cache->first + i) % cache->maxEntries];
+        int *link;
+        if (entry->live && entry->file == file && findEntry(cache, file, entry->pageNum, &link) >= 0) {
+            *link = entry->hashNext;
+            entry->live = FALSE;
+            cache->livePages--;
+            cache->liveBytes -= entry->length;
+        }
+    }
+    pthread_mutex_unlock(&cache->latch);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+void compressedCacheUsage(Compressed_cache *cache, int *numPages, long long *numBytes)
+{
+    pthread_mutex_lock(&cache->latch);
+    *numPages = cache->livePages;
+    *numBytes = cache->liveBytes;
+    pthread_mutex_unlock(&cache->latch);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int findEntry(Compressed_cache *cache, const void *file, PageNumber pageNum, int **link)
+{
+    // Caller holds the latch; link is left pointing at the reference to the entry found
+    int *ref = &cache->buckets[CC_BUCKET_OF(cache, file, pageNum)];
+    while (*ref >= 0) {
+        Cached_page *entry = &cache->entries[*ref];
+        if (entry->file == file && entry->pageNum == pageNum) {
+            *link = ref;
+            return *ref;
+        }
+        ref = &entry->hashNext;
+    }
+    return -1;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void dropOldest(Compressed_cache *cache)
+{
+    Cached_page *entry = &cache->entries[cache->first];
+    int *link;
+    if (entry->live && findEntry(cache, entry->file, entry->pageNum, &link) == cache->first) {
+        *link = entry->hashNext;
+        cache->livePages--;
+        cache->liveBytes -= entry->length;
+    }
+    cache->first = (cache->first + 1) % cache->maxEntries;
+    cache->count--;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static bool reserve(Compressed_cache *cache, int length)
+{
+    // Makes length contiguous bytes free at head, dropping the oldest pages as needed.
+    // The used bytes run from the oldest entry up to head, wrapping at the region's end
+    if ((size_t)length > cache->capacity) {
+        return FALSE;
+    }
+    for (;;) {
+        if (cache->count == cache->maxEntries) {
+            dropOldest(cache);
+            continue;
+        }
+        if (cache->count == 0) {
+            cache->head = 0;
+            return TRUE;
+        }
+        size_t tail = cache->entries[cache->first].offset;
+        if (cache->head > tail) {
+            if (cache->head + length <= cache->capacity) {
+                return TRUE;
+            }
+            cache->head = 0;  // the rest of the region stays unused until head passes again
+            continue;
+        }
+        if (cache->head + length <= tail) {
+            return TRUE;
+        }
+        dropOldest(cache);
+    }
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static bool putLength(unsigned char *dst, int *op, int dstCap, int length)
+{
+    // Extension bytes of a length whose nibble was 15
+    for (; length >= 255; length -= 255) {
+        if (*op >= dstCap) {
+            return FALSE;
+        }
+        dst[(*op)++] = 255;
+    }
+    if (*op >= dstCap) {
+        return FALSE;
+    }
+    dst[(*op)++] = (unsigned char)length;
+    return TRUE;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int compressPage(const unsigned char *src, int srcLen, unsigned char *dst, int dstCap)
+{
+    // Returns the compressed length, or -1 if it does not fit in dstCap
+    int table[1 << LZ_HASH_BITS];
+    int ip = 0, anchor = 0, op = 0;
+
+    memset(table, 0xff, sizeof(table));
+    for (;;) {
+        int matchLen = 0, offset = 0;
+        while (ip + LZ_MIN_MATCH <= srcLen) {
+            uint32_t seq;
+            memcpy(&seq, src + ip, sizeof(seq));
+            int hash = (int)((seq * 2654435761u) >> (32 - LZ_HASH_BITS));
+            int ref = table[hash];
+            table[hash] = ip;
+            if (ref >= 0 && ip - ref <= LZ_MAX_OFFSET && memcmp(src + ref, src + ip, LZ_MIN_MATCH) == 0) {
+                matchLen = LZ_MIN_MATCH;
+                while (ip + matchLen < srcLen && src[ref + matchLen] == src[ip + matchLen]) {
+                    matchLen++;
+                }
+                offset = ip - ref;
+                break;
+            }
+            ip++;
+        }
+        if (matchLen == 0) {
+            ip = srcLen;  // no match left: the rest is the last sequence's literals
+        }
+
+        int literals = ip - anchor;
+        if (op >= dstCap) {
+            return -1;
+        }
+        int token = op++;
+        dst[token] = (unsigned char)(((literals < 15) ? literals : 15) << 4);
+        if (literals >= 15 && !putLength(dst, &op, dstCap, literals - 15)) {
+            return -1;
+        }
+        if (op + literals > dstCap) {
+            return -1;
+        }
+        memcpy(dst + op, src + anchor, literals);
+        op += literals;
+        if (matchLen == 0) {
+            return op;
+        }
+
+        int extra = matchLen - LZ_MIN_MATCH;
+        dst[token] |= (unsigned char)((extra < 15) ? extra : 15);
+        if (op + 2 > dstCap) {
+            return -1;
+        }
+        dst[op++] = (unsigned char)(offset & 0xff);
+        dst[op++] = (unsigned char)(offset >> 8);
+        if (extra >= 15 && !putLength(dst, &op, dstCap, extra - 15)) {
+            return -1;
+        }
+        ip += matchLen;
+        anchor = ip;
+    }
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int decompressPage(const unsigned char *src, int srcLen, unsigned char *dst, int dstLen)
+{
+    // Returns the decompressed length, or -1 for input that would overrun either buffer
+    int ip = 0, op = 0;
+
+    while (ip < srcLen) {
+        int token = src[ip++];
+        int literals = token >> 4;
+        if (literals == 15) {
+            int b;
+            do {
+                if (ip >= srcLen) {
+                    return -1;
+                }
+                b = src[ip++];
+                literals += b;
+            } while (b == 255);
+        }
+        if (ip + literals > srcLen || op + literals > dstLen) {
+            return -1;
+        }
+        memcpy(dst + op, src + ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == srcLen) {
+            break;  // last sequence
+        }
+
+        if (ip + 2 > srcLen) {
+            return -1;
+        }
+        int offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        int matchLen = token & 15;
+        if (matchLen == 15) {
+            int b;
+            do {
+                if (ip >= srcLen) {
+                    return -1;
+                }
+                b = src[ip++];
+                matchLen += b;
+            } while (b == 255);
+        }
+        matchLen += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || op + matchLen > dstLen) {
+            return -1;
+        }
+        // Byte by byte: a match may overlap the bytes it produces
+        for (int i = 0; i < matchLen; i++, op++) {
+            dst[op] = dst[op - offset];
+        }
+    }
+    return op;
+}
@@ -0,0 +1,32 @@
+#ifndef COMPRESSED_CACHE_H_INCLUDED
+#define COMPRESSED_CACHE_H_INCLUDED
+
+#include "storage_mgr.h"
+#include "buffer_mgr.h"
+#include "dt.h"
+#include <stddef.h>
+
+// Second cache level behind a pool's frames: clean pages evicted from the frames are
+// kept compressed in one bounded region, oldest first out, until a miss takes them back.
+// A page is held at most once and never while it is resident; all calls are thread safe
+
+// Pages that do not compress below this size are not kept
+#define CC_MAX_STORED (PAGE_SIZE * 3 / 4)
+
+typedef struct Compressed_cache Compressed_cache;
+
+Compressed_cache *createCompressedCache(size_t capacity);
+void destroyCompressedCache(Compressed_cache *cache);
+
+// Compresses a page into packed (CC_MAX_STORED bytes) and returns the packed length,
+// or 0 if it does not compress below that; touches no cache state
+int compressedCachePack(const char *page, char *packed);
+// Keeps a packed page, replacing an older copy; FALSE if it was not kept (length 0 only drops the old copy)
+bool compressedCacheStore(Compressed_cache *cache, const void *file, PageNumber pageNum, const char *packed, int length);
+// Decompresses a kept page into page and forgets it; FALSE if it is not kept
+bool compressedCacheTake(Compressed_cache *cache, const void *file, PageNumber pageNum, char *page);
+// Forgets every page of a file
+void compressedCacheDropFile(Compressed_cache *cache, const void *file);
+void compressedCacheUsage(Compressed_cache *cache, int *numPages, long long *numBytes);
+
+#endif
@@ -43,6 +43,12 @@ typedef int RC;
 #define RC_BUFFER_POOL_NOT_SHUTDOWN 313
 #define RC_BUFFER_POOL_DELETION_FAILED 314
 #define RC_REPLACEMENT_PAGE_NOT_FOUND 315
+#define RC_POOL_RESIZE_FAILED 316
+#define RC_GLOBAL_POOL_NOT_FOUND 317
+#define RC_GLOBAL_POOL_IN_USE 318
+#define RC_TRACE_IN_USE 319
+#define RC_TRACE_NOT_STARTED 320
+#define RC_MEMORY_BUDGET_EXCEEDED 321
 
 #define RC_MARK_DIRTY_FAILED 400
 #define RC_FORCE_PAGE_ERROR 401
@@ -55,6 +61,8 @@ typedef int RC;
 #define RC_LFU_FAILED 408
 #define RC_PIN_FAILED 409
 #define RC_ERR 410
+#define RC_OPTIMISTIC_READ_FAILED 411
+#define RC_PIN_WAIT_TIMEOUT 412
 
 
 /* holder for error messages */
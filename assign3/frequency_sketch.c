@@ -0,0 +1,178 @@
+#include "frequency_sketch.h"
+#include "dt.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+// Counters are packed 16 to a 64-bit word; each page maps to one counter per row
+#define SKETCH_ROWS 4
+#define SKETCH_SAMPLE_FACTOR 10
+#define SKETCH_HALF_MASK 0x7777777777777777ULL
+
+struct Frequency_sketch
+{
+    unsigned long long *words;
+    unsigned int counterMask;   // counters - 1, a power of two minus one
+    long long additions;        // increments since the last aging
+    long long sampleSize;       // increments that trigger an aging
+    int aging;                  // set while one thread halves the counters
+};
+
+static uint64_t hashPage(const void *file, PageNumber pageNum);
+static void ageSketch(Frequency_sketch *sketch);
+static int sketchWords(int numFrames);
+static int getCounter(const unsigned long long *words, unsigned int counter);
+static void setCounter(unsigned long long *words, unsigned int counter, int count);
+
+Frequency_sketch *createFrequencySketch(int numFrames)
+{
+    Frequency_sketch *sketch = calloc(1, sizeof(Frequency_sketch));
+    if (sketch == NULL) {
+        return NULL;
+    }
+
+    int numWords = sketchWords(numFrames);
+    sketch->words = calloc(numWords, sizeof(unsigned long long));
+    if (sketch->words == NULL) {
+        free(sketch);
+        return NULL;
+    }
+    sketch->counterMask = (unsigned int)numWords * 16 - 1;
+    sketch->sampleSize = (long long)SKETCH_SAMPLE_FACTOR * (numFrames > 0 ? numFrames : 1);
+    return sketch;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+bool resizeFrequencySketch(Frequency_sketch *sketch, int numFrames)
+{
+    // Caller keeps every other use of the sketch out. A counter is the same hash masked
+    // to the width, so counts carry over: a doubled sketch copies each counter into both
+    // of its halves, a halved one keeps the larger of the two counters that merge
+    sketch->sampleSize = (long long)SKETCH_SAMPLE_FACTOR * (numFrames > 0 ? numFrames : 1);
+    int oldWords = (int)((sketch->counterMask + 1) / 16);
+    int numWords = sketchWords(numFrames);
+    if (numWords == oldWords) {
+        return TRUE;
+    }
+    unsigned long long *words = calloc(numWords, sizeof(unsigned long long));
+    if (words == NULL) {
+        return FALSE;
+    }
+
+    unsigned int oldMask = sketch->counterMask;
+    unsigned int newMask = (unsigned int)numWords * 16 - 1;
+    if (newMask > oldMask) {
+        for (unsigned int counter = 0; counter <= newMask; counter++) {
+            setCounter(words, counter, getCounter(sketch->words, counter & oldMask));
+        }
+    } else {
+        for (unsigned int counter = 0; counter <= oldMask; counter++) {
+            int count = getCounter(sketch->words, counter);
+            if (count > getCounter(words, counter & newMask)) {
+                setCounter(words, counter & newMask, count);
+            }
+        }
+    }
+    free(sketch->words);
+    sketch->words = words;
+    sketch->counterMask = newMask;
+    return TRUE;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+void destroyFrequencySketch(Frequency_sketch *sketch)
+{
+    if (sketch == NULL) {
+        return;
+    }
+    free(sketch->words);
+    free(sketch);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+void sketchIncrement(Frequency_sketch *sketch, const void *file, PageNumber pageNum)
+{
+    uint64_t hash = hashPage(file, pageNum);
+    uint32_t step = (uint32_t)(hash >> 32) | 1;
+    bool added = FALSE;
+
+    for (int row = 0; row < SKETCH_ROWS; row++) {
+        unsigned int counter = ((uint32_t)hash + row * step) & sketch->counterMask;
+        unsigned long long *word = &sketch->words[counter >> 4];
+        int shift = (counter & 15) * 4;
+        unsigned long long old = __atomic_load_n(word, __ATOMIC_RELAXED);
+        while (((old >> shift) & 15) < SKETCH_MAX_COUNT) {
+            if (__atomic_compare_exchange_n(word, &old, old + (1ULL << shift), TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                added = TRUE;
+                break;
+            }
+        }
+    }
+
+    // Saturated pages do not count toward the next aging
+    if (added && __atomic_add_fetch(&sketch->additions, 1, __ATOMIC_RELAXED) >= sketch->sampleSize) {
+        ageSketch(sketch);
+    }
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+int sketchEstimate(Frequency_sketch *sketch, const void *file, PageNumber pageNum)
+{
+    uint64_t hash = hashPage(file, pageNum);
+    uint32_t step = (uint32_t)(hash >> 32) | 1;
+    int estimate = SKETCH_MAX_COUNT;
+
+    // Every row overcounts through collisions only, so the smallest counter is the best guess
+    for (int row = 0; row < SKETCH_ROWS; row++) {
+        unsigned int counter = ((uint32_t)hash + row * step) & sketch->counterMask;
+        int count = (int)((__atomic_load_n(&sketch->words[counter >> 4], __ATOMIC_RELAXED) >> ((counter & 15) * 4)) & 15);
+        if (count < estimate) {
+            estimate = count;
+        }
+    }
+    return estimate;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void ageSketch(Frequency_sketch *sketch)
+{
+    // One thread halves every counter; the others carry on counting meanwhile
+    int idle = 0;
+    if (!__atomic_compare_exchange_n(&sketch->aging, &idle, 1, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    int numWords = (int)((sketch->counterMask + 1) / 16);
+    for (int i = 0; i < numWords; i++) {
+        unsigned long long old = __atomic_load_n(&sketch->words[i], __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&sketch->words[i], &old, (old >> 1) & SKETCH_HALF_MASK, TRUE,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+    }
+    __atomic_sub_fetch(&sketch->additions, sketch->sampleSize / 2, __ATOMIC_RELAXED);
+    __atomic_store_n(&sketch->aging, 0, __ATOMIC_RELEASE);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static uint64_t hashPage(const void *file, PageNumber pageNum)
+{
+    // splitmix64 finaliser over the file handle and page
+    uint64_t x = (uint64_t)(uintptr_t)file ^ ((uint64_t)(uint32_t)pageNum * 0x9E3779B97F4A7C15ULL);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int sketchWords(int numFrames)
+{
+    // One word, sixteen counters, per frame, rounded up to a power of two; small pools
+    // get enough counters that a few dozen pages rarely share all four
+    int numWords = 64;
+    while (numWords < numFrames) {
+        numWords <<= 1;
+    }
+    return numWords;
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static int getCounter(const unsigned long long *words, unsigned int counter)
+{
+    return (int)((words[counter >> 4] >> ((counter & 15) * 4)) & 15);
+}
+//--------------------------------------------------------------------------------------------------------------------------------------------------
+static void setCounter(unsigned long long *words, unsigned int counter, int count)
+{
+    int shift = (counter & 15) * 4;
+    words[counter >> 4] = (words[counter >> 4] & ~(15ULL << shift)) | ((unsigned long long)count << shift);
+}
@@ -0,0 +1,25 @@
+#ifndef FREQUENCY_SKETCH_H_INCLUDED
+#define FREQUENCY_SKETCH_H_INCLUDED
+
+#include "buffer_mgr.h"
+
+// Approximate access counts of (file, page) pairs: a count-min sketch of 4-bit counters,
+// four per page, halved after every ten accesses per tracked frame so old popularity fades.
+// Counts only ever overestimate; updates are lock free and may lose an increment under contention
+
+// Largest count a page can reach between agings
+#define SKETCH_MAX_COUNT 15
+
+typedef struct Frequency_sketch Frequency_sketch;
+
+// Sized for numFrames resident pages, at 8 bytes of counters per frame
+Frequency_sketch *createFrequencySketch(int numFrames);
+void destroyFrequencySketch(Frequency_sketch *sketch);
+// Resizes for a pool that now has numFrames frames, keeping the counts; FALSE when out
+// of memory, in which case only the aging period follows the new size
+bool resizeFrequencySketch(Frequency_sketch *sketch, int numFrames);
+
+void sketchIncrement(Frequency_sketch *sketch, const void *file, PageNumber pageNum);
+int sketchEstimate(Frequency_sketch *sketch, const void *file, PageNumber pageNum);
+
+#endif
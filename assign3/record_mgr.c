@@ -11,6 +11,8 @@ static Schema globalSchema;
 // Global scan pointer, initialized to NULL
 static PTR_Scan scan_pointer = NULL;
 
+static RC pinPageRingShared(BM_BufferPool *bufferPool, BM_PageHandle *pageHandle, PageNumber pageNumber, BM_AccessRing *ring);
+
 // Initializes the record manager
 RC initRecordManager(void *mgmtData)
 {
@@ -39,14 +41,20 @@ RC createTable(char *tableName, Schema *schema)
 // Opens a table by loading its data into the buffer pool
 RC openTable(RM_TableData *tableData, char *tableName)
 {
-    char fileName[64];
-    snprintf(fileName, sizeof(fileName), "%s.bin", tableName);
+    // The pool keeps a pointer to the file name, so it must outlive this call
+    char *fileName = malloc(64);
+    snprintf(fileName, 64, "%s.bin", tableName);
     
     // Allocate memory for a local schema and create a buffer pool
     Schema *localSchema = malloc(sizeof(Schema));
     BM_BufferPool *bufferPool = MAKE_POOL();
     
-    initBufferPool(bufferPool, fileName, 4, RS_FIFO, NULL);
+    // Tables share the global buffer pool when one is running, otherwise each gets a small private pool
+    if (globalBufferPoolActive()) {
+        attachBufferPool(bufferPool, fileName);
+    } else {
+        initBufferPool(bufferPool, fileName, 4, RS_FIFO, NULL);
+    }
     
     // Set up the table data structure
     tableData->name = tableName;           // Assign table name
@@ -63,6 +71,7 @@ RC closeTable(RM_TableData *tableData)
 {
     BM_BufferPool *bufferPool = (BM_BufferPool *)tableData->mgmtData;
     shutdownBufferPool(bufferPool);  // Terminate buffer pool
+    free(bufferPool->pageFile);      // File name allocated by openTable
     free(bufferPool);                // Release memory allocated for the buffer pool
     return RC_OK;
 }
@@ -78,19 +87,30 @@ RC deleteTable(char *tableName)
 }
 
 
-// Returns the number of tuples stored in a table
+// Returns the number of tuples stored in a table, or -1 if a page cannot be pinned
 int getNumTuples(RM_TableData *tableData)
 {
     int tupleCount = 0; // Initialize tuple count
     PageNumber pageNumber = 1; // Start from the first page
     BM_PageHandle *pageHandle = MAKE_PAGE_HANDLE(); // Create a page handle
     BM_BufferPool *bufferPool = (BM_BufferPool *)tableData->mgmtData; // Get buffer pool from table data
-    SM_FileHandle *fileHandle = (SM_FileHandle *)bufferPool->mgmtData; // Get file handle from buffer pool
+    int numPages = getNumFilePages(bufferPool); // Pages of the table, including new ones not written yet
+    BM_AccessRing *ring = NULL;
+
+    // A full pass over a large table goes through a private ring of frames
+    // so that it does not evict the pool's working set
+    if (numPages > bufferPool->numPages / 4)
+        ring = createAccessRing(bufferPool, BM_DEFAULT_RING_SIZE);
 
     // Iterate through all pages in the file
-    while (pageNumber < fileHandle->totalNumPages)
+    while (pageNumber < numPages)
     {
-        pinPage(bufferPool, pageHandle, pageNumber); // Pin the current page
+        // Pin the current page and keep writers out while counting
+        if (pinPageRingShared(bufferPool, pageHandle, pageNumber, ring) != RC_OK)
+        {
+            tupleCount = -1;
+            break;
+        }
 
         // Process each byte in the page
         for (int i = 0; i < PAGE_SIZE; i++)
@@ -100,9 +120,12 @@ int getNumTuples(RM_TableData *tableData)
                 tupleCount++;
         }
 
+        unpinPage(bufferPool, pageHandle); // Release the page before moving on
         pageNumber++;  // Move to the next page
     }
 
+    freeAccessRing(ring);
+    free(pageHandle);
     return tupleCount;  // Return the total number of tuples
 }
 
@@ -110,67 +133,86 @@ int getNumTuples(RM_TableData *tableData)
 // Function to insert a record into the table
 RC insertRecord(RM_TableData *rel, Record *record)
 {
-  int slot_number = 0, page_length, total_rec_length;
+  int slot_number = 0, page_length, total_rec_length, num_pages;
+  bool found = FALSE;
+  RC status;
   char *sp = NULL;
   RID id;
   
   PageNumber page_number;
   BM_BufferPool *buffer_pool = (BM_BufferPool *)rel->mgmtData;
   BM_PageHandle *page_handle = MAKE_PAGE_HANDLE();
-  SM_FileHandle *sm_handle = (SM_FileHandle *)buffer_pool->mgmtData;
   page_number = 1;
+  num_pages = getNumFilePages(buffer_pool);
   
   // Calculate the total record length
   total_rec_length = getRecordSize(rel->schema);
   
   // Iterate over each page to find available space
-  while (page_number < sm_handle->totalNumPages)
+  while (page_number < num_pages)
   {
-    // Pin the current page
-    pinPage(buffer_pool, page_handle, page_number);
+    // Pin the current page for reading
+    status = pinPageShared(buffer_pool, page_handle, page_number);
+    if (status != RC_OK)
+    {
+      free(page_handle);
+      return status;
+    }
     // Calculate the current page's used length
     page_length = strlen(page_handle->data);
+    // Unpin the page; a page with room is pinned again below
+    unpinPage(buffer_pool, page_handle);
 
     // Check for sufficient space to insert the record
     if (PAGE_SIZE - page_length > total_rec_length)
     {
-      // Determine the slot number based on used space
-      slot_number = page_length / total_rec_length;
-      // Unpin the page after finding sufficient space
+      // Pin the page to insert the record, excluding other readers and writers.
+      // Another inserter may have filled it since the shared check, so check again
+      status = pinPageExclusive(buffer_pool, page_handle, page_number);
+      if (status != RC_OK)
+      {
+        free(page_handle);
+        return status;
+      }
+      page_length = strlen(page_handle->data);
+      if (PAGE_SIZE - page_length > total_rec_length)
+      {
+        // Determine the slot number based on used space
+        slot_number = page_length / total_rec_length;
+        found = TRUE;
+        break; // Exit loop since appropriate space was found, keeping the page pinned
+      }
       unpinPage(buffer_pool, page_handle);
-      break; // Exit loop since appropriate space was found
     }
 
-    // Unpin the page if not enough space and proceed to the next
-    unpinPage(buffer_pool, page_handle);
+    // Not enough space: proceed to the next page
     page_number++;
   }
 
-  // If no slots available in existing pages, prepare a new page
-  if (slot_number == 0)
+  if (!found)
   {
-    // Create and pin a new page beyond the current page count
-    pinPage(buffer_pool, page_handle, page_number + 1);
-    // Unpin the newly created page
-    unpinPage(buffer_pool, page_handle);
+    // No page has room: append one, zeroed in memory without reading the file
+    status = pinNewPageExclusive(buffer_pool, page_handle);
+    if (status != RC_OK)
+    {
+      free(page_handle);
+      return status;
+    }
+    page_number = page_handle->pageNum;
   }
-
-  // Pin the page to insert the record
-  pinPage(buffer_pool, page_handle, page_number);
   // Position pointer at the end of the page's content
   sp = page_handle->data + strlen(page_handle->data);
 
   // Copy record data to the end of the page
   strcpy(sp, record->data);
-  // Mark the page as dirty due to the modification
-  markDirty(buffer_pool, page_handle);
-  // Unpin the page after modification
-  unpinPage(buffer_pool, page_handle);
+  // Mark the page as dirty due to the modification and unpin it
+  unpinPageDirty(buffer_pool, page_handle);
 
   // Set record ID with the page and slot number
   id.page = page_number;
   id.slot = slot_number;
   record->id = id;
+  free(page_handle);
   
   // Return success
   return RC_OK;
@@ -184,12 +226,12 @@ RC deleteRecord(RM_TableData *tableData, RID id)
     BM_PageHandle *pageHandle = MAKE_PAGE_HANDLE();
     PageNumber pageNumber = id.page;
 
-    pinPage(bufferPool, pageHandle, pageNumber);
-    markDirty(bufferPool, pageHandle);
-    unpinPage(bufferPool, pageHandle);
+    RC status = pinPageExclusive(bufferPool, pageHandle, pageNumber);
+    if (status == RC_OK)
+        unpinPageDirty(bufferPool, pageHandle);
     free(pageHandle);
 
-    return RC_OK;
+    return status;
 }
 
 
@@ -203,14 +245,15 @@ RC updateRecord(RM_TableData *tableData, Record *record)
     PageNumber pageNumber = id.page;
     int recordLength = getRecordSize(tableData->schema);
 
-    pinPage(bufferPool, pageHandle, pageNumber);
-    char *startPos = pageHandle->data + (recordLength * slotNumber);
-    memcpy(startPos, record->data, recordLength); // Using memcpy for binary data safety
-    markDirty(bufferPool, pageHandle);
-    unpinPage(bufferPool, pageHandle);
+    RC status = pinPageExclusive(bufferPool, pageHandle, pageNumber);
+    if (status == RC_OK) {
+        char *startPos = pageHandle->data + (recordLength * slotNumber);
+        memcpy(startPos, record->data, recordLength); // Using memcpy for binary data safety
+        unpinPageDirty(bufferPool, pageHandle);
+    }
     free(pageHandle);
 
-    return RC_OK;
+    return status;
 }
 
 
@@ -223,22 +266,42 @@ RC getRecord(RM_TableData *tableData, RID id, Record *record)
     int slotNumber = id.slot;
     int recordLength = getRecordSize(tableData->schema);
 
-    pinPage(bufferPool, pageHandle, pageNumber);
-    char *startPos = pageHandle->data + (recordLength * slotNumber);
-    memcpy(record->data, startPos, recordLength); // Using memcpy for binary data safety
-    unpinPage(bufferPool, pageHandle);
+    // Resident, unpinned pages are read without pinning them
+    RC status = RC_OK;
+    if (readPageOptimistic(bufferPool, pageNumber, recordLength * slotNumber, recordLength, record->data) != RC_OK) {
+        status = pinPageShared(bufferPool, pageHandle, pageNumber);
+        if (status == RC_OK) {
+            char *startPos = pageHandle->data + (recordLength * slotNumber);
+            memcpy(record->data, startPos, recordLength); // Using memcpy for binary data safety
+            unpinPage(bufferPool, pageHandle);
+        }
+    }
     free(pageHandle);
 
-    return RC_OK;
+    return status;
 }
 
 
 // Initiates a scan operation on a given table with specific conditions.
+// Tables larger than a quarter of the buffer pool are scanned through a ring.
 RC startScan(RM_TableData *rel, RM_ScanHandle *scan, Expr *cond)
+{
+    BM_BufferPool *buffer_pool = (BM_BufferPool *)rel->mgmtData;
+    int ringSize = 0;
+
+    if (getNumFilePages(buffer_pool) > buffer_pool->numPages / 4)
+        ringSize = BM_DEFAULT_RING_SIZE;
+
+    return startScanWithRing(rel, scan, cond, ringSize);
+}
+
+
+// Initiates a scan whose page misses are confined to a private ring of
+// ringSize frames; a ringSize of 0 lets the scan use the whole buffer pool.
+RC startScanWithRing(RM_TableData *rel, RM_ScanHandle *scan, Expr *cond, int ringSize)
 {
     // Retrieve buffer pool and file handle from the relation's management data.
     BM_BufferPool *buffer_pool = (BM_BufferPool *)rel->mgmtData;
-    SM_FileHandle *file_handle = (SM_FileHandle *)buffer_pool->mgmtData;
   
     // Allocate and initialize memory for the auxiliary scan data structure.
     AUX_Scan *aux_scan = (AUX_Scan *)malloc(sizeof(AUX_Scan));
@@ -247,9 +310,10 @@ RC startScan(RM_TableData *rel, RM_ScanHandle *scan, Expr *cond)
     }
     aux_scan->_slotID = 1;
     aux_scan->_sPage = 1;
-    aux_scan->_numPages = file_handle->totalNumPages;
+    aux_scan->_numPages = getNumFilePages(buffer_pool);
     aux_scan->pHandle = MAKE_PAGE_HANDLE();
     aux_scan->_recLength = getRecordSize(rel->schema);
+    aux_scan->ring = (ringSize > 0) ? createAccessRing(buffer_pool, ringSize) : NULL;
  
     // Set scan management and table data in the scan handle.
     scan->mgmtData = cond;  // Set condition expression in scan management data.
@@ -268,6 +332,7 @@ RC next(RM_ScanHandle *scan, Record *record)
   RM_TableData *rm_data = scan->rel;
   Operator *res, *new_res;
   AUX_Scan *aux_scan = search(scan, scan_pointer);
+  RC status;
   
   // Allocate memory for comparison value
   Value **cValue = (Value **)malloc(sizeof(Value *));
@@ -282,8 +347,10 @@ RC next(RM_ScanHandle *scan, Record *record)
       rec = res->args[1];
       while(aux_scan->_sPage < aux_scan->_numPages)
       {
-        // Pin the page
-        pinPage(rm_data->mgmtData, aux_scan->pHandle, aux_scan->_sPage);
+        // Pin the page and keep writers out while reading it
+        status = pinPageRingShared(rm_data->mgmtData, aux_scan->pHandle, aux_scan->_sPage, aux_scan->ring);
+        if (status != RC_OK)
+          return status;
         aux_scan->_recsPage = strlen(aux_scan->pHandle->data) / aux_scan->_recLength;
         while(aux_scan->_slotID < aux_scan->_recsPage)
         {
@@ -292,7 +359,12 @@ RC next(RM_ScanHandle *scan, Record *record)
           id.page = aux_scan->_sPage;
           
           // Retrieve the record
-          getRecord(rm_data, id, record);
+          status = getRecord(rm_data, id, record);
+          if (status != RC_OK)
+          {
+            unpinPage(rm_data->mgmtData, aux_scan->pHandle);
+            return status;
+          }
           // Get attribute value
           getAttr(record, rm_data->schema, rec->expr.attrRef, cValue); 
           // Check condition
@@ -305,6 +377,8 @@ RC next(RM_ScanHandle *scan, Record *record)
           }
           aux_scan->_slotID++;
         }
+        // No match on this page: drop the pin and its latch
+        unpinPage(rm_data->mgmtData, aux_scan->pHandle);
         break;
       }
       break;
@@ -315,8 +389,10 @@ RC next(RM_ScanHandle *scan, Record *record)
       rec = res->args[1];
       while(aux_scan->_sPage < aux_scan->_numPages)
       {
-        // Pin the page
-        pinPage(rm_data->mgmtData, aux_scan->pHandle, aux_scan->_sPage);
+        // Pin the page and keep writers out while reading it
+        status = pinPageRingShared(rm_data->mgmtData, aux_scan->pHandle, aux_scan->_sPage, aux_scan->ring);
+        if (status != RC_OK)
+          return status;
         aux_scan->_recsPage = strlen(aux_scan->pHandle->data) / aux_scan->_recLength;
         while(aux_scan->_slotID < aux_scan->_recsPage)
         {
@@ -325,7 +401,12 @@ RC next(RM_ScanHandle *scan, Record *record)
           id.slot = aux_scan->_slotID;
           
           // Retrieve the record
-          getRecord(rm_data, id, record);
+          status = getRecord(rm_data, id, record);
+          if (status != RC_OK)
+          {
+            unpinPage(rm_data->mgmtData, aux_scan->pHandle);
+            return status;
+          }
           // Get attribute value
           getAttr(record, rm_data->schema, rec->expr.attrRef, cValue);
           // Check condition
@@ -352,6 +433,8 @@ RC next(RM_ScanHandle *scan, Record *record)
           } 
           aux_scan->_slotID++;
         }
+        // No match on this page: drop the pin and its latch
+        unpinPage(rm_data->mgmtData, aux_scan->pHandle);
         break;     
       }
       break;
@@ -366,15 +449,22 @@ RC next(RM_ScanHandle *scan, Record *record)
       {
         while(aux_scan->_numPages > aux_scan->_sPage)
         {
-          // Pin the page
-          pinPage(rm_data->mgmtData, aux_scan->pHandle, aux_scan->_sPage);
+          // Pin the page and keep writers out while reading it
+          status = pinPageRingShared(rm_data->mgmtData, aux_scan->pHandle, aux_scan->_sPage, aux_scan->ring);
+          if (status != RC_OK)
+            return status;
           aux_scan->_recsPage = strlen(aux_scan->pHandle->data) / aux_scan->_recLength;
           while(aux_scan->_slotID < aux_scan->_recsPage)
           {
             id.slot = aux_scan->_slotID;
             id.page = aux_scan->_sPage;
             // Retrieve the record
-            getRecord(rm_data, id, record);
+            status = getRecord(rm_data, id, record);
+            if (status != RC_OK)
+            {
+              unpinPage(rm_data->mgmtData, aux_scan->pHandle);
+              return status;
+            }
             // Get attribute value
             getAttr(record, rm_data->schema, rec->expr.attrRef, cValue);
             if((cValue[0]->v.intV > len->expr.cons->v.intV) && (rm_data->schema->dataTypes[rec->expr.attrRef] == DT_INT))
@@ -386,6 +476,8 @@ RC next(RM_ScanHandle *scan, Record *record)
             }
             aux_scan->_slotID++;
           }
+          // No match on this page: drop the pin and its latch
+          unpinPage(rm_data->mgmtData, aux_scan->pHandle);
           break; 
         }
         break;
@@ -405,6 +497,8 @@ RC next(RM_ScanHandle *scan, Record *record)
 RC closeScan(RM_ScanHandle *scanHandle)
 {
     AUX_Scan *auxScan = search(scanHandle, scan_pointer);
+    if (auxScan != NULL)
+        freeAccessRing(auxScan->ring);
     // Assuming delete function handles freeing of auxScan internally
     return delete(scanHandle, &scan_pointer);
 }
@@ -652,3 +746,17 @@ RC setAttr(Record *record, Schema *schema, int attrNum, Value *value)
   
     return RC_OK;
 }
+
+
+// Pins a page through a scan's ring and latches it shared; nothing stays pinned on failure
+static RC pinPageRingShared(BM_BufferPool *bufferPool, BM_PageHandle *pageHandle, PageNumber pageNumber, BM_AccessRing *ring)
+{
+    RC status = pinPageRing(bufferPool, pageHandle, pageNumber, ring);
+    if (status != RC_OK)
+        return status;
+
+    status = latchPage(bufferPool, pageHandle, BM_LATCH_SHARED);
+    if (status != RC_OK)
+        unpinPage(bufferPool, pageHandle);
+    return status;
+}
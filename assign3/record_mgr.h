@@ -29,6 +29,7 @@ extern RC getRecord (RM_TableData *rel, RID id, Record *record);
 
 // scans
 extern RC startScan (RM_TableData *rel, RM_ScanHandle *scan, Expr *cond);
+extern RC startScanWithRing (RM_TableData *rel, RM_ScanHandle *scan, Expr *cond, int ringSize);
 extern RC next (RM_ScanHandle *scan, Record *record);
 extern RC closeScan (RM_ScanHandle *scan);
 
@@ -9,6 +9,7 @@
 typedef struct AUX_Scan
 {
     BM_PageHandle *pHandle;
+    BM_AccessRing *ring;
     int _sPage;
     int _slotID;
     int _recLength;
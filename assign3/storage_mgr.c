@@ -2,9 +2,14 @@
 #include "storage_mgr.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+
+// Pages handed to one pwritev call by writeBlocks
+#define WRITE_BLOCKS_IOV 64
 
 // Initialize storage manager
 RC initializeStorageManager() {
@@ -117,6 +122,43 @@ RC writeBlock(int pageNum, SM_FileHandle *fHandle, SM_PageHandle memPage) {
     return RC_OK;
 }
 
+// Write numPages consecutive pages, starting at pageNum, with vectored writes
+RC writeBlocks(int pageNum, int numPages, SM_FileHandle *fHandle, SM_PageHandle *memPages) {
+    if (numPages <= 0 || pageNum < 0 || pageNum + numPages > fHandle->totalNumPages) return RC_WRITE_FAILED;
+
+    FILE *file = fHandle->mgmtInfo;
+    if (fflush(file) != 0) return RC_WRITE_FAILED; // Push buffered writes and drop buffered reads around the raw write
+    int fd = fileno(file);
+
+    int done = 0;
+    while (done < numPages) {
+        struct iovec iov[WRITE_BLOCKS_IOV];
+        int batch = numPages - done < WRITE_BLOCKS_IOV ? numPages - done : WRITE_BLOCKS_IOV;
+        for (int i = 0; i < batch; i++) {
+            iov[i].iov_base = memPages[done + i];
+            iov[i].iov_len = PAGE_SIZE;
+        }
+
+        ssize_t written = pwritev(fd, iov, batch, (off_t)(pageNum + done) * PAGE_SIZE);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return RC_WRITE_FAILED;
+        done += written / PAGE_SIZE;
+
+        // Short write: finish the page it stopped in before going on
+        size_t partial = written % PAGE_SIZE;
+        while (partial > 0 && partial < PAGE_SIZE) {
+            ssize_t rest = pwrite(fd, memPages[done] + partial, PAGE_SIZE - partial,
+                                  (off_t)(pageNum + done) * PAGE_SIZE + partial);
+            if (rest < 0 && errno == EINTR) continue;
+            if (rest <= 0) return RC_WRITE_FAILED;
+            partial += rest;
+        }
+        if (partial == PAGE_SIZE) done++;
+    }
+
+    return RC_OK;
+}
+
 // Write the current page from memory into the file
 RC writeCurrentBlock(SM_FileHandle *fHandle, SM_PageHandle memPage) {
     return writeBlock(fHandle->curPagePos, fHandle, memPage);
@@ -150,3 +192,15 @@ RC ensureCapacity(int numberOfPages, SM_FileHandle *fHandle) {
 
     return RC_OK;
 }
+
+// Grow the file to numberOfPages without writing the new pages; they read as zeros
+RC extendPageFile(int numberOfPages, SM_FileHandle *fHandle) {
+    if (numberOfPages <= fHandle->totalNumPages) return RC_OK;
+
+    FILE *file = fHandle->mgmtInfo;
+    if (fflush(file) != 0) return RC_WRITE_FAILED;
+    if (ftruncate(fileno(file), (off_t)numberOfPages * PAGE_SIZE) != 0) return RC_WRITE_FAILED;
+
+    fHandle->totalNumPages = numberOfPages;
+    return RC_OK;
+}
@@ -0,0 +1,2017 @@
+#include "storage_mgr.h"
+#include "buffer_mgr_stat.h"
+#include "buffer_mgr.h"
+#include "dberror.h"
+#include "frequency_sketch.h"
+#include "test_helper.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// var to store the current test's name
+char *testName;
+
+#define TESTPF "test_pool.bin"
+#define TESTPF2 "test_pool2.bin"
+
+// shape of the concurrent pin stress test
+#define STRESS_THREADS 8
+#define STRESS_PAGES 64
+#define STRESS_FRAMES 16
+#define STRESS_ITERATIONS 4000
+
+typedef struct StressArgs {
+    BM_BufferPool *bm;
+    int id;
+    int increments[STRESS_PAGES];
+    int errors;
+} StressArgs;
+
+// writer of the optimistic read test fills a whole page with one byte value per round.
+// It writes only the rounds the test asks for, so the page is never copied while it
+// changes: a race detector sees the hand-offs, the buffer manager still sees two threads
+#define OPTIMISTIC_ROUNDS 2000
+
+typedef struct OptimisticArgs {
+    BM_BufferPool *bm;
+    int requested;  // last round the writer may write, -1 stops it; atomic
+    int completed;  // last round written; atomic
+} OptimisticArgs;
+
+// the pin wait test's helper thread unpins a page after a short delay
+typedef struct PinWaitArgs {
+    BM_BufferPool *bm;
+    BM_PageHandle *page;
+    int delayMs;
+} PinWaitArgs;
+
+// writer thread of testPageLatches
+typedef struct LatchArgs {
+    BM_BufferPool *bm;
+    PageNumber pageNum;
+    int done;
+} LatchArgs;
+
+// threads of testConcurrentInit open pools on one file at the same time
+#define INIT_THREADS 4
+
+typedef struct InitArgs {
+    BM_BufferPool bm;
+    RC status;
+} InitArgs;
+
+// test and helper methods
+static void createPagedFile(int numPages);
+static bool isResident(BM_BufferPool *bm, PageNumber pageNum);
+
+static void testScanRing (void);
+static void testFrameArena (void);
+static void testConcurrentPins (void);
+static void *stressWorker (void *arg);
+static void testBackgroundWriter (void);
+static void testPrefetch (void);
+static void testResizePool (void);
+static void testGlobalPool (void);
+static void testFrameHandles (void);
+static void testOptimisticRead (void);
+static void *optimisticWriter (void *arg);
+static void runOptimisticWriter (OptimisticArgs *args, int round);
+static void testPoolStats (void);
+static void testDirtyFlush (void);
+static void testWriteCoalescing (void);
+static void testWarmRestart (void);
+static void testCustomPolicy (void);
+static void testAccessTrace (void);
+static void testPinWait (void);
+static void *delayedUnpin (void *arg);
+static void testCompressedCache (void);
+static void testMemoryGovernor (void);
+static void testSnapshotWriteback (void);
+static void testAdmissionFilter (void);
+static void testFreeFrameList (void);
+static void testPageLatches (void);
+static void testPinHints (void);
+static void testNewPages (void);
+static void testSketchResize (void);
+static void *exclusiveWriter (void *arg);
+static void testConcurrentInit (void);
+static void *initWorker (void *arg);
+
+// main method
+int
+main (void)
+{
+    testName = "";
+
+    testScanRing();
+    testFrameArena();
+    testConcurrentPins();
+    testBackgroundWriter();
+    testPrefetch();
+    testResizePool();
+    testGlobalPool();
+    testFrameHandles();
+    testOptimisticRead();
+    testPoolStats();
+    testDirtyFlush();
+    testWriteCoalescing();
+    testWarmRestart();
+    testCustomPolicy();
+    testAccessTrace();
+    testPinWait();
+    testCompressedCache();
+    testMemoryGovernor();
+    testSnapshotWriteback();
+    testAdmissionFilter();
+    testFreeFrameList();
+    testPageLatches();
+    testPinHints();
+    testNewPages();
+    testSketchResize();
+    testConcurrentInit();
+    return 0;
+}
+
+// ************************************************************
+void
+createPagedFile(int numPages)
+{
+    SM_FileHandle fh;
+
+    CHECK(createPageFile(TESTPF));
+    CHECK(openPageFile(TESTPF, &fh));
+    CHECK(ensureCapacity(numPages, &fh));
+    CHECK(closePageFile(&fh));
+}
+
+bool
+isResident(BM_BufferPool *bm, PageNumber pageNum)
+{
+    PageNumber *frames = getFrameContents(bm);
+    bool found = FALSE;
+    int i;
+
+    for (i = 0; i < bm->numPages; i++)
+        if (frames[i] == pageNum)
+            found = TRUE;
+
+    free(frames);
+    return found;
+}
+
+// ************************************************************
+void
+testScanRing (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_AccessRing *ring;
+    int i;
+
+    testName = "scan through an access ring keeps the hot set resident";
+
+    createPagedFile(64);
+    CHECK(initBufferPool(bm, TESTPF, 16, RS_LRU, NULL));
+
+    // warm up a small working set
+    for (i = 0; i < 4; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+
+    // a ring larger than a quarter of the pool is clamped
+    ring = createAccessRing(bm, BM_DEFAULT_RING_SIZE);
+    ASSERT_EQUALS_INT(4, ring->size, "ring clamped to a quarter of the pool");
+
+    // full scan over the rest of the table
+    for (i = 4; i < 64; i++)
+    {
+        CHECK(pinPageRing(bm, h, i, ring));
+        ASSERT_EQUALS_INT(i, h->pageNum, "scan page pinned");
+        CHECK(unpinPage(bm, h));
+    }
+
+    for (i = 0; i < 4; i++)
+        ASSERT_TRUE(isResident(bm, i), "hot page survived the scan");
+    ASSERT_EQUALS_INT(64, getNumReadIO(bm), "every page read exactly once");
+
+    // hot pages are still hits
+    for (i = 0; i < 4; i++)
+    {
+        CHECK(pinPageRing(bm, h, i, ring));
+        CHECK(unpinPage(bm, h));
+    }
+    ASSERT_EQUALS_INT(64, getNumReadIO(bm), "no extra reads for hot pages");
+
+    freeAccessRing(ring);
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile(TESTPF));
+
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testFrameArena (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    char *first = NULL;
+    int i;
+
+    testName = "frames are carved from one page-aligned arena";
+
+    createPagedFile(8);
+    CHECK(initBufferPool(bm, TESTPF, 8, RS_FIFO, NULL));
+
+    for (i = 0; i < 8; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        ASSERT_TRUE(((uintptr_t) h->data % PAGE_SIZE) == 0, "frame is page aligned");
+        if (i == 0)
+            first = h->data;
+        else
+            ASSERT_TRUE(h->data == first + (size_t) i * PAGE_SIZE, "frames are contiguous");
+        CHECK(unpinPage(bm, h));
+    }
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile(TESTPF));
+
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void *
+stressWorker (void *arg)
+{
+    StressArgs *args = (StressArgs *) arg;
+    BM_PageHandle h;
+    unsigned int seed = 42 + args->id;
+    int i, counter, tag;
+
+    for (i = 0; i < STRESS_ITERATIONS; i++)
+    {
+        PageNumber p = rand_r(&seed) % STRESS_PAGES;
+
+        if (pinPage(args->bm, &h, p) != RC_OK)
+        {
+            args->errors++;
+            continue;
+        }
+
+        // every page carries its own number right after the counter
+        memcpy(&tag, h.data + sizeof(int), sizeof(int));
+        if (h.pageNum != p || tag != p)
+            args->errors++;
+
+        // each thread only updates the pages it owns, so no page latch is needed
+        if (p % STRESS_THREADS == args->id)
+        {
+            memcpy(&counter, h.data, sizeof(int));
+            counter++;
+            memcpy(h.data, &counter, sizeof(int));
+            if (markDirty(args->bm, &h) != RC_OK)
+                args->errors++;
+            args->increments[p]++;
+        }
+
+        if (unpinPage(args->bm, &h) != RC_OK)
+            args->errors++;
+    }
+    return NULL;
+}
+
+void
+testConcurrentPins (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    pthread_t threads[STRESS_THREADS];
+    StressArgs args[STRESS_THREADS];
+    int expected[STRESS_PAGES];
+    int i, p, counter, errors = 0;
+
+    testName = "concurrent pin, mark dirty and unpin from many threads";
+
+    createPagedFile(STRESS_PAGES);
+    CHECK(initBufferPool(bm, TESTPF, STRESS_FRAMES, RS_LRU, NULL));
+
+    // tag every page with its number
+    for (p = 0; p < STRESS_PAGES; p++)
+    {
+        CHECK(pinPage(bm, h, p));
+        memcpy(h->data + sizeof(int), &p, sizeof(int));
+        CHECK(markDirty(bm, h));
+        CHECK(unpinPage(bm, h));
+        expected[p] = 0;
+    }
+
+    for (i = 0; i < STRESS_THREADS; i++)
+    {
+        memset(&args[i], 0, sizeof(StressArgs));
+        args[i].bm = bm;
+        args[i].id = i;
+        pthread_create(&threads[i], NULL, stressWorker, &args[i]);
+    }
+    for (i = 0; i < STRESS_THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        errors += args[i].errors;
+        for (p = 0; p < STRESS_PAGES; p++)
+            expected[p] += args[i].increments[p];
+    }
+    ASSERT_EQUALS_INT(0, errors, "every pin saw the right page");
+
+    CHECK(shutdownBufferPool(bm));
+
+    // every update must have reached the disk
+    CHECK(initBufferPool(bm, TESTPF, STRESS_FRAMES, RS_FIFO, NULL));
+    for (p = 0; p < STRESS_PAGES; p++)
+    {
+        CHECK(pinPage(bm, h, p));
+        memcpy(&counter, h->data, sizeof(int));
+        if (counter != expected[p])
+            errors++;
+        CHECK(unpinPage(bm, h));
+    }
+    ASSERT_EQUALS_INT(0, errors, "no update was lost across evictions");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile(TESTPF));
+
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testBackgroundWriter (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    bool *dirty;
+    int i, numDirty = 0;
+
+    testName = "background writer cleans victims before eviction";
+
+    createPagedFile(32);
+    CHECK(initBufferPool(bm, TESTPF, 8, RS_LRU, NULL));
+
+    for (i = 0; i < 8; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        sprintf(h->data, "%s-%i", "Page", i);
+        CHECK(markDirty(bm, h));
+        CHECK(unpinPage(bm, h));
+    }
+
+    CHECK(startBackgroundWriter(bm, 5, 8));
+    ASSERT_ERROR(startBackgroundWriter(bm, 5, 8), "only one writer per pool");
+
+    // give the writer a few rounds
+    for (i = 0; i < 100 && getNumWriteIO(bm) < 8; i++)
+        usleep(10000);
+
+    dirty = getDirtyFlags(bm);
+    for (i = 0; i < 8; i++)
+        if (dirty[i])
+            numDirty++;
+    free(dirty);
+    ASSERT_EQUALS_INT(0, numDirty, "writer cleaned every unpinned frame");
+    ASSERT_EQUALS_INT(8, getNumWriteIO(bm), "each dirty page written once");
+
+    CHECK(stopBackgroundWriter(bm));
+
+    // misses now find clean victims and do not write in the foreground
+    for (i = 8; i < 16; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    ASSERT_EQUALS_INT(8, getNumWriteIO(bm), "no synchronous write-back on misses");
+
+    // the cleaned pages made it to disk
+    CHECK(pinPage(bm, h, 3));
+    ASSERT_EQUALS_STRING("Page-3", h->data, "page content written by the writer");
+    CHECK(unpinPage(bm, h));
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile(TESTPF));
+
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testPrefetch (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    PageNumber pages[] = {2, 3, 4, 5, 6, 7};
+    int *fixCounts;
+    int i, pinned = 0;
+
+    testName = "prefetched pages are resident and unpinned";
+
+    createPagedFile(16);
+    CHECK(initBufferPool(bm, TESTPF, 8, RS_FIFO, NULL));
+
+    CHECK(prefetchPage(bm, 1));
+    CHECK(prefetchPages(bm, pages, 6));
+    CHECK(prefetchPage(bm, 100));  // beyond the end of the file: ignored
+
+    for (i = 0; i < 100 && getNumReadIO(bm) < 7; i++)
+        usleep(10000);
+    ASSERT_EQUALS_INT(7, getNumReadIO(bm), "prefetch read every requested page");
+
+    fixCounts = getFixCounts(bm);
+    for (i = 0; i < 8; i++)
+        pinned += fixCounts[i];
+    free(fixCounts);
+    ASSERT_EQUALS_INT(0, pinned, "prefetch does not pin");
+
+    for (i = 1; i < 8; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    ASSERT_EQUALS_INT(7, getNumReadIO(bm), "pins after prefetch are hits");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile(TESTPF));
+
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testResizePool (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle *pinned = MAKE_PAGE_HANDLE();
+    PageNumber prefetched[] = {8, 9, 10, 11};
+    BM_PoolStats stats;
+    char *pinnedData;
+    int i;
+
+    testName = "growing and shrinking a live buffer pool";
+
+    createPagedFile(16);
+    CHECK(initBufferPool(bm, TESTPF, 4, RS_LRU, NULL));
+
+    CHECK(pinPage(bm, pinned, 0));
+    pinnedData = pinned->data;
+    for (i = 1; i < 4; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+
+    // grow while a page is pinned: resident pages stay put
+    CHECK(resizeBufferPool(bm, 8));
+    ASSERT_EQUALS_INT(8, bm->numPages, "pool reports its new size");
+    for (i = 0; i < 4; i++)
+        ASSERT_TRUE(isResident(bm, i), "page survives growing");
+    ASSERT_TRUE(pinned->data == pinnedData, "pinned frame does not move");
+    CHECK(unpinPage(bm, pinned));
+
+    for (i = 4; i < 8; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    ASSERT_EQUALS_INT(8, getNumReadIO(bm), "new frames are used without evictions");
+
+    // page 1 is cold and dirty, pages 4-7 are the hottest
+    CHECK(pinPage(bm, h, 1));
+    sprintf(h->data, "%s-%i", "Page", h->pageNum);
+    CHECK(markDirty(bm, h));
+    CHECK(unpinPage(bm, h));
+    for (i = 4; i < 8; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+
+    CHECK(resizeBufferPool(bm, 4));
+    ASSERT_EQUALS_INT(4, bm->numPages, "pool reports its new size");
+    for (i = 4; i < 8; i++)
+        ASSERT_TRUE(isResident(bm, i), "hottest pages survive shrinking");
+    ASSERT_EQUALS_INT(1, getNumWriteIO(bm), "dirty victim written back");
+    for (i = 4; i < 8; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    ASSERT_EQUALS_INT(8, getNumReadIO(bm), "hottest pages are still hits");
+
+    CHECK(pinPage(bm, h, 1));
+    ASSERT_EQUALS_STRING("Page-1", h->data, "written back page reads back");
+    ASSERT_ERROR(resizeBufferPool(bm, 1), "cannot release a pinned frame");
+    CHECK(unpinPage(bm, h));
+
+    CHECK(shutdownBufferPool(bm));
+
+    // prefetched pages moved out of released frames are still prefetch hits
+    CHECK(initBufferPool(bm, TESTPF, 4, RS_LRU, NULL));
+    for (i = 0; i < 4; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(resizeBufferPool(bm, 8));
+    CHECK(prefetchPages(bm, prefetched, 4));
+    for (i = 0; i < 100 && getNumReadIO(bm) < 8; i++)
+        usleep(10000);
+    CHECK(resizeBufferPool(bm, 4));
+    for (i = 0; i < 4; i++)
+    {
+        CHECK(pinPage(bm, h, prefetched[i]));
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(8, (int) stats.readIO, "moved pages are hits");
+    ASSERT_EQUALS_INT(4, (int) stats.prefetchHits, "and count as prefetch hits");
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile(TESTPF));
+
+    free(h);
+    free(pinned);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+static int
+countResident (BM_BufferPool *bm)
+{
+    PageNumber *frames = getFrameContents(bm);
+    int i, count = 0;
+
+    for (i = 0; i < bm->numPages; i++)
+        if (frames[i] != NO_PAGE)
+            count++;
+
+    free(frames);
+    return count;
+}
+
+void
+testGlobalPool (void)
+{
+    BM_BufferPool *a = MAKE_POOL();
+    BM_BufferPool *a2 = MAKE_POOL();
+    BM_BufferPool *b = MAKE_POOL();
+    BM_BufferPool *c = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    SM_FileHandle fh;
+    char name[] = "test_pool.bin";
+    int i, round;
+
+    testName = "tables share one global buffer pool";
+
+    createPagedFile(8);
+    CHECK(createPageFile(TESTPF2));
+    CHECK(openPageFile(TESTPF2, &fh));
+    CHECK(ensureCapacity(8, &fh));
+    CHECK(closePageFile(&fh));
+
+    ASSERT_ERROR(attachBufferPool(a, TESTPF), "no global pool yet");
+    CHECK(initGlobalBufferPool(6, RS_LRU, NULL));
+    ASSERT_TRUE(globalBufferPoolActive(), "global pool is running");
+    CHECK(attachBufferPool(a, TESTPF));
+    CHECK(attachBufferPool(a2, "test_pool.bin"));
+    CHECK(attachBufferPool(b, TESTPF2));
+    ASSERT_TRUE(a->mgmtData == a2->mgmtData, "pools on one file share its handle");
+    ASSERT_EQUALS_INT(6, b->numPages, "attached pools see the global size");
+
+    // the same page number in two files lives in two frames
+    CHECK(pinPage(a, h, 0));
+    sprintf(h->data, "%s", "file-a");
+    CHECK(markDirty(a, h));
+    CHECK(unpinPage(a, h));
+    CHECK(pinPage(b, h, 0));
+    sprintf(h->data, "%s", "file-b");
+    CHECK(markDirty(b, h));
+    CHECK(unpinPage(b, h));
+    CHECK(pinPage(a2, h, 0));
+    ASSERT_EQUALS_STRING("file-a", h->data, "page keyed by file and page number");
+    CHECK(unpinPage(a2, h));
+
+    // a private pool on an attached file joins the global pool instead of caching it twice
+    CHECK(initBufferPool(c, name, 3, RS_FIFO, NULL));
+    ASSERT_TRUE(c->mgmtData == a->mgmtData, "private pool shares the attached handle");
+    ASSERT_EQUALS_INT(6, c->numPages, "private pool sees the global size");
+    ASSERT_TRUE(c->strategy == RS_LRU, "private pool runs the global strategy");
+    CHECK(pinPage(c, h, 0));
+    ASSERT_EQUALS_STRING("file-a", h->data, "private pool sees the global frames");
+    CHECK(unpinPage(c, h));
+    CHECK(shutdownBufferPool(c));
+
+    // a busy file takes frames from an idle one
+    for (round = 0; round < 3; round++)
+        for (i = 0; i < 7; i++)
+        {
+            CHECK(pinPage(a, h, i));
+            CHECK(unpinPage(a, h));
+        }
+    ASSERT_EQUALS_INT(6, countResident(a), "hot file holds every frame");
+    ASSERT_EQUALS_INT(0, countResident(b), "idle file was evicted");
+
+    ASSERT_ERROR(shutdownGlobalBufferPool(), "pools are still attached");
+    CHECK(shutdownBufferPool(b));
+    CHECK(shutdownBufferPool(a2));
+    CHECK(shutdownBufferPool(a));
+    CHECK(shutdownGlobalBufferPool());
+    ASSERT_TRUE(!globalBufferPoolActive(), "global pool is gone");
+
+    // detaching wrote both files back
+    CHECK(initBufferPool(b, TESTPF2, 2, RS_FIFO, NULL));
+    CHECK(pinPage(b, h, 0));
+    ASSERT_EQUALS_STRING("file-b", h->data, "page written back on detach");
+    CHECK(unpinPage(b, h));
+    CHECK(shutdownBufferPool(b));
+
+    CHECK(destroyPageFile(TESTPF));
+    CHECK(destroyPageFile(TESTPF2));
+
+    free(h);
+    free(a);
+    free(a2);
+    free(b);
+    free(c);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testFrameHandles (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle stale;
+    PageNumber *frames;
+    bool *dirty;
+    int *fixCounts;
+
+    testName = "page handles remember their frame";
+
+    createPagedFile(4);
+    CHECK(initBufferPool(bm, TESTPF, 2, RS_LRU, NULL));
+
+    CHECK(pinPage(bm, h, 1));
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 2));
+    frames = getFrameContents(bm);
+    ASSERT_EQUALS_INT(2, frames[h->frame], "handle names the frame holding the page");
+    free(frames);
+
+    sprintf(h->data, "%s", "Page-2");
+    CHECK(unpinPageDirty(bm, h));
+    dirty = getDirtyFlags(bm);
+    fixCounts = getFixCounts(bm);
+    ASSERT_TRUE(dirty[h->frame], "unpinPageDirty marks the frame dirty");
+    ASSERT_EQUALS_INT(0, fixCounts[h->frame], "unpinPageDirty releases the pin");
+    free(dirty);
+    free(fixCounts);
+
+    // once the frame holds another page, the old handle must not touch it
+    stale = *h;
+    CHECK(pinPage(bm, h, 1));
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 3));
+    ASSERT_EQUALS_INT(stale.frame, h->frame, "evicted page's frame was reused");
+    ASSERT_ERROR(unpinPage(bm, &stale), "stale handle does not unpin the new page");
+    ASSERT_ERROR(markDirty(bm, &stale), "stale handle does not dirty the new page");
+    fixCounts = getFixCounts(bm);
+    ASSERT_EQUALS_INT(1, fixCounts[h->frame], "new page is still pinned");
+    free(fixCounts);
+    CHECK(unpinPage(bm, h));
+    ASSERT_EQUALS_INT(1, getNumWriteIO(bm), "dirty page written back on eviction");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile(TESTPF));
+
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void *
+optimisticWriter (void *arg)
+{
+    OptimisticArgs *args = (OptimisticArgs *) arg;
+    BM_PageHandle h;
+    int round, requested;
+
+    for (round = 1; ; round++)
+    {
+        while ((requested = __atomic_load_n(&args->requested, __ATOMIC_ACQUIRE)) >= 0 && requested < round)
+            ;
+        if (requested < 0 || pinPage(args->bm, &h, 0) != RC_OK)
+            break;
+        memset(h.data, 'a' + round % 26, PAGE_SIZE);
+        unpinPageDirty(args->bm, &h);
+        __atomic_store_n(&args->completed, round, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+void
+runOptimisticWriter (OptimisticArgs *args, int round)
+{
+    // lets the writer write up to round and waits until it has
+    __atomic_store_n(&args->requested, round, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&args->completed, __ATOMIC_ACQUIRE) < round)
+        ;
+}
+
+void
+testOptimisticRead (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle snapshot;
+    OptimisticArgs args;
+    pthread_t writer;
+    char buf[PAGE_SIZE];
+    int i, round, torn = 0, missed = 0;
+
+    testName = "optimistic reads validate against concurrent changes";
+
+    createPagedFile(4);
+    CHECK(initBufferPool(bm, TESTPF, 4, RS_LRU, NULL));
+
+    CHECK(pinPage(bm, h, 1));
+    sprintf(h->data, "%s", "Page-1");
+    ASSERT_TRUE(readPageOptimistic(bm, 1, 0, 7, buf) == RC_OPTIMISTIC_READ_FAILED, "pinned page is not read optimistically");
+    CHECK(unpinPageDirty(bm, h));
+
+    CHECK(readPageOptimistic(bm, 1, 0, 7, buf));
+    ASSERT_EQUALS_STRING("Page-1", buf, "optimistic read sees the page");
+    ASSERT_EQUALS_INT(1, getNumReadIO(bm), "optimistic read does no I/O");
+    ASSERT_TRUE(readPageOptimistic(bm, 2, 0, 7, buf) == RC_PAGE_NOT_FOUND, "only resident pages are read");
+
+    // a pin between begin and validate invalidates the read
+    CHECK(beginOptimisticRead(bm, &snapshot, 1));
+    CHECK(pinPage(bm, h, 1));
+    CHECK(unpinPage(bm, h));
+    ASSERT_TRUE(!validateOptimisticRead(bm, &snapshot), "read overlapping a pin is rejected");
+    CHECK(beginOptimisticRead(bm, &snapshot, 1));
+    ASSERT_TRUE(validateOptimisticRead(bm, &snapshot), "undisturbed read validates");
+
+    // a validated read never sees a half written page: every other round, another
+    // thread rewrites the page between the two halves of the copy
+    CHECK(pinPage(bm, h, 0));
+    CHECK(unpinPage(bm, h));
+    args.bm = bm;
+    args.requested = 0;
+    args.completed = 0;
+    pthread_create(&writer, NULL, optimisticWriter, &args);
+    for (round = 1; round <= OPTIMISTIC_ROUNDS; round++)
+    {
+        CHECK(beginOptimisticRead(bm, &snapshot, 0));
+        memcpy(buf, snapshot.data, PAGE_SIZE / 2);
+        if (round % 2 == 0)
+            runOptimisticWriter(&args, round / 2);
+        memcpy(buf + PAGE_SIZE / 2, snapshot.data + PAGE_SIZE / 2, PAGE_SIZE / 2);
+        if (!validateOptimisticRead(bm, &snapshot))
+            continue;
+        if (round % 2 == 0)
+            missed++;
+        for (i = 1; i < PAGE_SIZE; i++)
+            if (buf[i] != buf[0])
+            {
+                torn++;
+                break;
+            }
+    }
+    __atomic_store_n(&args.requested, -1, __ATOMIC_RELEASE);
+    pthread_join(writer, NULL);
+    ASSERT_EQUALS_INT(0, missed, "reads overlapping a write are rejected");
+    ASSERT_EQUALS_INT(0, torn, "no torn page passed validation");
+    ASSERT_TRUE(readPageOptimistic(bm, 0, 0, PAGE_SIZE, buf) == RC_OK, "quiet page reads optimistically");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile(TESTPF));
+
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testPoolStats (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle h[4];
+    BM_PoolStats stats;
+    int i;
+
+    testName = "pool statistics";
+
+    createPagedFile(8);
+    CHECK(initBufferPool(bm, TESTPF, 3, RS_FIFO, NULL));
+
+    // three misses and a hit, all four pins held at once
+    for (i = 0; i < 3; i++)
+        CHECK(pinPage(bm, &h[i], i));
+    CHECK(pinPage(bm, &h[3], 0));
+    CHECK(unpinPageDirty(bm, &h[1]));
+    for (i = 0; i < 4; i++)
+        if (i != 1)
+            CHECK(unpinPage(bm, &h[i]));
+
+    // page 0 leaves clean, page 1 has to be written first
+    CHECK(pinPage(bm, &h[0], 3));
+    CHECK(unpinPage(bm, &h[0]));
+    CHECK(pinPage(bm, &h[0], 4));
+    CHECK(unpinPage(bm, &h[0]));
+
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(1, (int) stats.hits, "hits");
+    ASSERT_EQUALS_INT(5, (int) stats.misses, "misses");
+    ASSERT_EQUALS_INT(5, (int) stats.readIO, "reads");
+    ASSERT_EQUALS_INT(getNumReadIO(bm), (int) stats.readIO, "reads match getNumReadIO");
+    ASSERT_EQUALS_INT(1, (int) stats.writeIO, "writes");
+    ASSERT_EQUALS_INT(1, (int) stats.cleanEvictions, "clean evictions");
+    ASSERT_EQUALS_INT(1, (int) stats.dirtyEvictions, "dirty evictions");
+    ASSERT_EQUALS_INT(4, stats.peakPinned, "peak pinned");
+    ASSERT_EQUALS_INT(0, stats.pinnedNow, "nothing pinned now");
+    ASSERT_TRUE(stats.avgPinLatencyNs > 0, "pin latency measured");
+    ASSERT_TRUE(stats.victimSearches >= 2, "strategy picked the victims");
+
+    // a prefetched page that gets pinned counts as useful
+    CHECK(prefetchPage(bm, 6));
+    for (i = 0; i < 100 && getNumReadIO(bm) < 6; i++)
+        usleep(10000);
+    CHECK(pinPage(bm, &h[0], 6));
+    CHECK(unpinPage(bm, &h[0]));
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(1, (int) stats.prefetchLoads, "prefetch loads");
+    ASSERT_EQUALS_INT(1, (int) stats.prefetchHits, "prefetched page was used");
+
+    CHECK(resetPoolStats(bm));
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(0, (int) (stats.hits + stats.misses + stats.readIO + stats.writeIO), "counters reset");
+    ASSERT_EQUALS_INT(0, getNumReadIO(bm), "read count reset");
+    ASSERT_EQUALS_INT(0, stats.peakPinned, "peak restarts from current pins");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile(TESTPF));
+
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testDirtyFlush (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    SM_FileHandle fh;
+    SM_PageHandle data = malloc(PAGE_SIZE);
+    PageNumber *frames;
+    bool *dirty;
+    int i;
+
+    testName = "dirty page list and ordered flush";
+
+    createPagedFile(8);
+    CHECK(initBufferPool(bm, TESTPF, 8, RS_FIFO, NULL));
+
+    // dirty every page, newest frames holding the lowest pages
+    for (i = 7; i >= 0; i--)
+    {
+        CHECK(pinPage(bm, h, i));
+        sprintf(h->data, "%s-%i", "Dirty", i);
+        CHECK(unpinPageDirty(bm, h));
+    }
+
+    // a pinned dirty page is skipped and stays listed for the next flush
+    CHECK(pinPage(bm, h, 3));
+    CHECK(forceFlushPool(bm));
+    ASSERT_EQUALS_INT(7, getNumWriteIO(bm), "unpinned dirty pages written once");
+    dirty = getDirtyFlags(bm);
+    frames = getFrameContents(bm);
+    for (i = 0; i < 8; i++)
+        ASSERT_TRUE(dirty[i] == (frames[i] == 3), "only the pinned page stays dirty");
+    free(frames);
+    free(dirty);
+
+    CHECK(forceFlushPool(bm));
+    ASSERT_EQUALS_INT(7, getNumWriteIO(bm), "pinned page still skipped");
+    CHECK(unpinPage(bm, h));
+    CHECK(forceFlushPool(bm));
+    ASSERT_EQUALS_INT(8, getNumWriteIO(bm), "skipped page written after unpin");
+    CHECK(forceFlushPool(bm));
+    ASSERT_EQUALS_INT(8, getNumWriteIO(bm), "clean pool writes nothing");
+
+    // re-dirtying a flushed page puts it back on the list
+    CHECK(pinPage(bm, h, 5));
+    sprintf(h->data, "%s-%i", "Again", 5);
+    CHECK(markDirty(bm, h));
+    CHECK(unpinPage(bm, h));
+    CHECK(shutdownBufferPool(bm));
+
+    CHECK(openPageFile(TESTPF, &fh));
+    for (i = 0; i < 8; i++)
+    {
+        char expected[PAGE_SIZE];
+        sprintf(expected, "%s-%i", (i == 5) ? "Again" : "Dirty", i);
+        CHECK(readBlock(i, &fh, data));
+        ASSERT_EQUALS_STRING(expected, data, "flushed page reached the file");
+    }
+    CHECK(closePageFile(&fh));
+    CHECK(destroyPageFile(TESTPF));
+
+    free(data);
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testWriteCoalescing (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolStats stats;
+    SM_FileHandle fh;
+    SM_PageHandle data = malloc(PAGE_SIZE);
+    int i;
+
+    testName = "coalesced writes of consecutive dirty pages";
+
+    createPagedFile(16);
+    CHECK(initBufferPool(bm, TESTPF, 16, RS_FIFO, NULL));
+
+    // pages 10 and 11 stay clean, page 5 is pinned: three runs 0-4, 6-9 and 12-15
+    for (i = 0; i < 16; i++)
+    {
+        if (i == 10 || i == 11)
+            continue;
+        CHECK(pinPage(bm, h, i));
+        sprintf(h->data, "%s-%i", "Run", i);
+        CHECK(unpinPageDirty(bm, h));
+    }
+    CHECK(pinPage(bm, h, 5));
+    CHECK(forceFlushPool(bm));
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(13, (int) stats.writeIO, "unpinned dirty pages written");
+    ASSERT_EQUALS_INT(3, (int) stats.writeCalls, "one write per run");
+    CHECK(unpinPage(bm, h));
+    CHECK(forceFlushPool(bm));
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(4, (int) stats.writeCalls, "pinned page written on its own");
+    CHECK(shutdownBufferPool(bm));
+
+    // evicting a dirty page also cleans its dirty neighbours in the same write
+    CHECK(initBufferPool(bm, TESTPF, 4, RS_FIFO, NULL));
+    for (i = 0; i < 4; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        sprintf(h->data, "%s-%i", "Evict", i);
+        CHECK(unpinPageDirty(bm, h));
+    }
+    CHECK(pinPage(bm, h, 4));
+    CHECK(unpinPage(bm, h));
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(4, (int) stats.writeIO, "victim and neighbours written");
+    ASSERT_EQUALS_INT(1, (int) stats.writeCalls, "in a single write");
+    ASSERT_EQUALS_INT(1, (int) stats.dirtyEvictions, "one dirty eviction");
+    CHECK(pinPage(bm, h, 5));
+    CHECK(unpinPage(bm, h));
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(4, (int) stats.writeIO, "neighbours were already clean");
+    CHECK(shutdownBufferPool(bm));
+
+    // pages pinNewPage appended lie past the file's end until written, and coalesce too
+    CHECK(initBufferPool(bm, TESTPF, 4, RS_FIFO, NULL));
+    for (i = 0; i < 4; i++)
+    {
+        CHECK(pinNewPage(bm, h));
+        sprintf(h->data, "%s-%i", "New", h->pageNum);
+        CHECK(unpinPageDirty(bm, h));
+    }
+    CHECK(pinPage(bm, h, 0));
+    CHECK(unpinPage(bm, h));
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(4, (int) stats.writeIO, "new victim and new neighbours written");
+    ASSERT_EQUALS_INT(1, (int) stats.writeCalls, "new pages in a single write");
+    CHECK(shutdownBufferPool(bm));
+
+    CHECK(openPageFile(TESTPF, &fh));
+    for (i = 0; i < 16; i++)
+    {
+        char expected[PAGE_SIZE];
+        if (i < 4)
+            sprintf(expected, "%s-%i", "Evict", i);
+        else if (i == 10 || i == 11)
+            expected[0] = '\0';
+        else
+            sprintf(expected, "%s-%i", "Run", i);
+        CHECK(readBlock(i, &fh, data));
+        ASSERT_EQUALS_STRING(expected, data, "coalesced page reached the file");
+    }
+    CHECK(closePageFile(&fh));
+    CHECK(destroyPageFile(TESTPF));
+
+    free(data);
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testWarmRestart (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolStats stats;
+    PageNumber used[] = {7, 2, 5};
+    int i;
+
+    testName = "warm restart from saved resident pages";
+
+    createPagedFile(10);
+    remove(TESTPF ".warm");
+
+    // nothing saved yet: enabling is a cold start
+    CHECK(initBufferPool(bm, TESTPF, 4, RS_LRU, NULL));
+    CHECK(enableWarmRestart(bm));
+    for (i = 0; i < 3; i++)
+    {
+        CHECK(pinPage(bm, h, used[i]));
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(shutdownBufferPool(bm));
+    ASSERT_TRUE(access(TESTPF ".warm", F_OK) == 0, "shutdown saved the resident pages");
+
+    // the whole set fits and is read back without a single pin
+    CHECK(initBufferPool(bm, TESTPF, 4, RS_LRU, NULL));
+    CHECK(enableWarmRestart(bm));
+    for (i = 0; i < 100 && getNumReadIO(bm) < 3; i++)
+        usleep(10000);
+    for (i = 0; i < 3; i++)
+        ASSERT_TRUE(isResident(bm, used[i]), "saved page reloaded");
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(3, (int) stats.prefetchLoads, "reloaded in the background");
+    CHECK(pinPage(bm, h, 5));
+    CHECK(unpinPage(bm, h));
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(1, (int) stats.hits, "first pin after restart hits");
+    CHECK(shutdownBufferPool(bm));
+
+    // a smaller pool keeps only the hottest page, the one pinned last
+    CHECK(initBufferPool(bm, TESTPF, 1, RS_LRU, NULL));
+    CHECK(enableWarmRestart(bm));
+    for (i = 0; i < 100 && getNumReadIO(bm) < 1; i++)
+        usleep(10000);
+    ASSERT_TRUE(isResident(bm, 5), "hottest page reloaded");
+    CHECK(shutdownBufferPool(bm));
+
+    // under FIFO the hottest page is the one referenced last, not the one in the busiest frame
+    remove(TESTPF ".warm");
+    CHECK(initBufferPool(bm, TESTPF, 2, RS_FIFO, NULL));
+    CHECK(enableWarmRestart(bm));
+    for (i = 1; i <= 5; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(pinPage(bm, h, 4));
+    CHECK(unpinPage(bm, h));
+    CHECK(shutdownBufferPool(bm));
+    CHECK(initBufferPool(bm, TESTPF, 1, RS_FIFO, NULL));
+    CHECK(enableWarmRestart(bm));
+    for (i = 0; i < 100 && getNumReadIO(bm) < 1; i++)
+        usleep(10000);
+    ASSERT_TRUE(isResident(bm, 4), "page referenced last reloaded under FIFO");
+    CHECK(shutdownBufferPool(bm));
+
+    CHECK(destroyPageFile(TESTPF));
+    remove(TESTPF ".warm");
+
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+// most recently used: evicts the evictable frame referenced last, and counts its hooks
+typedef struct MruCounters
+{
+    int loads;
+    int pins;
+    int unpins;
+    int evictions;
+    int destroyed;
+} MruCounters;
+
+typedef struct MruState
+{
+    long long *stamps;
+    long long clock;
+    MruCounters *counters;
+} MruState;
+
+static void *
+mruCreate (int numFrames, void *config)
+{
+    MruState *state = calloc(1, sizeof(MruState));
+    state->stamps = calloc(numFrames, sizeof(long long));
+    state->counters = config;
+    return state;
+}
+
+static void
+mruDestroy (void *state)
+{
+    MruState *mru = state;
+    mru->counters->destroyed++;
+    free(mru->stamps);
+    free(mru);
+}
+
+static void
+mruLoad (void *state, int frame, PageNumber pageNum)
+{
+    MruState *mru = state;
+    (void) pageNum;
+    mru->stamps[frame] = ++mru->clock;
+    mru->counters->loads++;
+}
+
+static void
+mruPin (void *state, int frame)
+{
+    MruState *mru = state;
+    mru->stamps[frame] = ++mru->clock;
+    mru->counters->pins++;
+}
+
+static void
+mruUnpin (void *state, int frame, bool dirty)
+{
+    (void) frame;
+    (void) dirty;
+    ((MruState *) state)->counters->unpins++;
+}
+
+static void
+mruEvict (void *state, int frame)
+{
+    (void) frame;
+    ((MruState *) state)->counters->evictions++;
+}
+
+static int
+mruVictim (void *state, int numFrames, bool (*evictable) (const void *pool, int frame), const void *pool)
+{
+    MruState *mru = state;
+    int victim = -1;
+    int i;
+
+    for (i = 0; i < numFrames; i++)
+        if (evictable(pool, i) && (victim < 0 || mru->stamps[i] > mru->stamps[victim]))
+            victim = i;
+    return victim;
+}
+
+void
+testCustomPolicy (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    MruCounters counters = {0, 0, 0, 0, 0};
+    BM_ReplacementPolicy mru = {
+        "MRU", mruCreate, mruDestroy, NULL, mruLoad, mruPin, mruUnpin, mruEvict, mruVictim, NULL, &counters
+    };
+    BM_PoolStats stats;
+    int i;
+
+    testName = "replacement policy passed as stratData";
+
+    createPagedFile(6);
+    CHECK(initBufferPool(bm, TESTPF, 3, RS_FIFO, &mru));
+
+    for (i = 0; i < 3; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(pinPage(bm, h, 0));
+    CHECK(unpinPage(bm, h));
+
+    // FIFO would evict page 0, the policy evicts the page just referenced
+    CHECK(pinPage(bm, h, 3));
+    CHECK(unpinPage(bm, h));
+    ASSERT_TRUE(!isResident(bm, 0), "most recently used page evicted");
+    ASSERT_TRUE(isResident(bm, 1) && isResident(bm, 2), "older pages kept");
+
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(1, (int) stats.victimSearches, "policy chose the victim");
+    ASSERT_EQUALS_INT(4, counters.loads, "load hook");
+    ASSERT_EQUALS_INT(1, counters.pins, "pin hook on the hit");
+    ASSERT_EQUALS_INT(5, counters.unpins, "unpin hook");
+    ASSERT_EQUALS_INT(1, counters.evictions, "evict hook");
+
+    CHECK(shutdownBufferPool(bm));
+    ASSERT_EQUALS_INT(1, counters.destroyed, "policy state destroyed with the frames");
+    CHECK(destroyPageFile(TESTPF));
+
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+#define TESTTRACE "test_trace.bin"
+
+void
+testAccessTrace (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_TraceHeader header;
+    BM_TraceRecord records[8];
+    int expectedOps[] = {BM_TRACE_PIN, BM_TRACE_DIRTY, BM_TRACE_UNPIN, BM_TRACE_PIN,
+                         BM_TRACE_DIRTY, BM_TRACE_UNPIN};
+    FILE *trace;
+    int i, numRecords;
+
+    testName = "access trace capture";
+
+    createPagedFile(4);
+    CHECK(initBufferPool(bm, TESTPF, 2, RS_FIFO, NULL));
+    CHECK(pinPage(bm, h, 3));
+    CHECK(unpinPage(bm, h));
+
+    ASSERT_EQUALS_INT(RC_TRACE_NOT_STARTED, stopBufferTrace(), "no trace running");
+    CHECK(startBufferTrace(TESTTRACE));
+    ASSERT_EQUALS_INT(RC_TRACE_IN_USE, startBufferTrace(TESTTRACE), "one trace at a time");
+
+    CHECK(pinPage(bm, h, 1));
+    CHECK(markDirty(bm, h));
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 3));
+    CHECK(unpinPageDirty(bm, h));
+    CHECK(stopBufferTrace());
+
+    // not traced any more
+    CHECK(pinPage(bm, h, 2));
+    CHECK(unpinPage(bm, h));
+    CHECK(shutdownBufferPool(bm));
+
+    trace = fopen(TESTTRACE, "rb");
+    ASSERT_TRUE(trace != NULL, "trace file written");
+    ASSERT_TRUE(fread(&header, sizeof(header), 1, trace) == 1, "trace header");
+    ASSERT_EQUALS_INT(BM_TRACE_MAGIC, (int) header.magic, "trace magic");
+    numRecords = fread(records, sizeof(BM_TraceRecord), 8, trace);
+    fclose(trace);
+
+    ASSERT_EQUALS_INT(6, numRecords, "one record per call, unpinPageDirty counts twice");
+    for (i = 0; i < numRecords; i++)
+    {
+        ASSERT_EQUALS_INT(expectedOps[i], records[i].op, "operation recorded in order");
+        ASSERT_EQUALS_INT(records[0].pool, records[i].pool, "same pool");
+        if (i > 0)
+            ASSERT_TRUE(records[i].timeNs >= records[i - 1].timeNs, "timestamps ascend");
+    }
+    ASSERT_EQUALS_INT(1, records[0].pageNum, "pinned page");
+    ASSERT_EQUALS_INT(0, records[0].hit, "page 1 was a miss");
+    ASSERT_EQUALS_INT(3, records[3].pageNum, "second pinned page");
+    ASSERT_EQUALS_INT(1, records[3].hit, "page 3 was a hit");
+
+    CHECK(destroyPageFile(TESTPF));
+    remove(TESTTRACE);
+
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void *
+delayedUnpin (void *arg)
+{
+    PinWaitArgs *args = (PinWaitArgs *) arg;
+
+    usleep(args->delayMs * 1000);
+    unpinPage(args->bm, args->page);
+    return NULL;
+}
+
+void
+testPinWait (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PageHandle *held = MAKE_PAGE_HANDLE();
+    BM_PageHandle *other = MAKE_PAGE_HANDLE();
+    BM_PoolStats stats;
+    PinWaitArgs args;
+    pthread_t unpinner;
+    RC rc;
+
+    testName = "pins wait for a free frame";
+
+    createPagedFile(4);
+    CHECK(initBufferPool(bm, TESTPF, 2, RS_FIFO, NULL));
+    CHECK(pinPage(bm, held, 0));
+    CHECK(pinPage(bm, other, 1));
+
+    // by default a full pool fails at once
+    rc = pinPage(bm, h, 2);
+    ASSERT_EQUALS_INT(RC_FIFO_FAILED, rc, "no wait without setPinWait");
+    ASSERT_TRUE(setPinWait(bm, -2) != RC_OK, "negative timeouts other than forever are rejected");
+
+    // nobody unpins: the pin gives up at the deadline
+    CHECK(setPinWait(bm, 50));
+    rc = pinPage(bm, h, 2);
+    ASSERT_EQUALS_INT(RC_PIN_WAIT_TIMEOUT, rc, "pin times out");
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(1, (int) stats.pinWaits, "one waiting pin");
+    ASSERT_EQUALS_INT(1, (int) stats.pinWaitTimeouts, "one timeout");
+    ASSERT_TRUE(stats.avgPinWaitNs >= 40000000.0, "wait lasted about the timeout");
+
+    // another thread unpins while we wait
+    CHECK(setPinWait(bm, BM_PIN_WAIT_FOREVER));
+    args.bm = bm;
+    args.page = held;
+    args.delayMs = 20;
+    pthread_create(&unpinner, NULL, delayedUnpin, &args);
+    CHECK(pinPage(bm, h, 2));
+    pthread_join(unpinner, NULL);
+    ASSERT_EQUALS_INT(2, h->pageNum, "waiting pin got a frame");
+    ASSERT_TRUE(!isResident(bm, 0), "unpinned page was evicted for it");
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(2, (int) stats.pinWaits, "second pin waited");
+    ASSERT_EQUALS_INT(1, (int) stats.pinWaitTimeouts, "and did not time out");
+
+    // resident pages never wait
+    CHECK(pinPage(bm, held, 1));
+    CHECK(unpinPage(bm, held));
+    CHECK(unpinPage(bm, h));
+    CHECK(unpinPage(bm, other));
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile(TESTPF));
+
+    free(h);
+    free(held);
+    free(other);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testCompressedCache (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolStats stats;
+    char noise[PAGE_SIZE];
+    int i, reads;
+
+    testName = "compressed cache keeps evicted clean pages";
+
+    createPagedFile(8);
+    CHECK(initBufferPool(bm, TESTPF, 2, RS_FIFO, NULL));
+    ASSERT_TRUE(setCompressedCache(bm, -1) != RC_OK, "negative size rejected");
+    CHECK(setCompressedCache(bm, 4 * PAGE_SIZE));
+
+    // write distinct record-like pages, and one that does not compress
+    for (i = 0; i < 4; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        sprintf(h->data, "Page-%i", i);
+        CHECK(unpinPageDirty(bm, h));
+    }
+    srand(42);
+    for (i = 0; i < PAGE_SIZE; i++)
+        noise[i] = (char) rand();
+    CHECK(pinPage(bm, h, 4));
+    memcpy(h->data, noise, PAGE_SIZE);
+    CHECK(unpinPageDirty(bm, h));
+    CHECK(pinPage(bm, h, 5));
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 6));
+    CHECK(unpinPage(bm, h));
+
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(4, stats.tierPages, "written pages kept once flushed, noise page not kept");
+    ASSERT_TRUE(stats.tierBytes < PAGE_SIZE, "record pages compress well");
+
+    // misses on kept pages need no read and see the written contents
+    reads = getNumReadIO(bm);
+    for (i = 0; i < 4; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        ASSERT_EQUALS_INT(i, atoi(h->data + 5), "page contents survive compression");
+        CHECK(unpinPage(bm, h));
+    }
+    ASSERT_EQUALS_INT(reads, getNumReadIO(bm), "served from compressed copies");
+    CHECK(pinPage(bm, h, 4));
+    ASSERT_TRUE(memcmp(h->data, noise, PAGE_SIZE) == 0, "uncompressed page read back from the file");
+    CHECK(unpinPage(bm, h));
+    ASSERT_EQUALS_INT(reads + 1, getNumReadIO(bm), "noise page was read");
+
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(4, (int) stats.tierHits, "four compressed hits");
+
+    // turning it off drops the copies
+    CHECK(setCompressedCache(bm, 0));
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(0, stats.tierPages, "nothing kept when off");
+    CHECK(pinPage(bm, h, 0));
+    ASSERT_EQUALS_STRING("Page-0", h->data, "file holds the flushed page");
+    CHECK(unpinPage(bm, h));
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile(TESTPF));
+
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testMemoryGovernor (void)
+{
+    BM_BufferPool *cold = MAKE_POOL();
+    BM_BufferPool *hot = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolBudget budget;
+    SM_FileHandle fh;
+    int i, round;
+
+    testName = "memory governor caps and moves frames";
+
+    createPagedFile(16);
+    CHECK(createPageFile(TESTPF2));
+    CHECK(openPageFile(TESTPF2, &fh));
+    CHECK(ensureCapacity(16, &fh));
+    CHECK(closePageFile(&fh));
+
+    // the second pool only fits by taking frames from the first
+    CHECK(setMemoryBudget(16 * PAGE_SIZE));
+    CHECK(initBufferPool(cold, TESTPF, 10, RS_LRU, NULL));
+    CHECK(initBufferPool(hot, TESTPF2, 10, RS_LRU, NULL));
+    ASSERT_EQUALS_INT(6, cold->numPages, "frames taken from the idle pool");
+    ASSERT_EQUALS_INT(10, hot->numPages, "new pool got what it asked for");
+    CHECK(getPoolBudget(hot, &budget));
+    ASSERT_EQUALS_INT(16, (int) budget.budgetFrames, "budget in frames");
+    ASSERT_EQUALS_INT(16, (int) budget.totalFrames, "budget used up");
+    ASSERT_TRUE(resizeBufferPool(hot, 11) == RC_MEMORY_BUDGET_EXCEEDED, "growing past the budget fails");
+
+    // one pool keeps missing, the other hardly
+    for (round = 0; round < 3; round++)
+        for (i = 0; i < 16; i++)
+        {
+            CHECK(pinPage(hot, h, i));
+            CHECK(unpinPage(hot, h));
+        }
+    CHECK(pinPage(cold, h, 0));
+    CHECK(unpinPage(cold, h));
+    CHECK(getPoolBudget(hot, &budget));
+    ASSERT_TRUE(budget.demand > 4.0, "hot pool misses on every pin");
+    ASSERT_EQUALS_INT(10, budget.usedFrames, "hot pool frames all hold pages");
+    CHECK(getPoolBudget(cold, &budget));
+    ASSERT_TRUE(budget.demand < 1.0, "cold pool hardly misses");
+
+    CHECK(rebalanceBufferPools());
+    ASSERT_EQUALS_INT(5, cold->numPages, "a quarter of the cold pool's spare frames moved");
+    ASSERT_EQUALS_INT(11, hot->numPages, "to the hot pool");
+    CHECK(getPoolBudget(hot, &budget));
+    ASSERT_TRUE(budget.demand == 0.0, "demand restarts after a rebalance");
+    ASSERT_EQUALS_INT(16, (int) budget.totalFrames, "still within the budget");
+
+    // a smaller budget shrinks the pools, never below their minimum
+    CHECK(setMemoryBudget(12 * PAGE_SIZE));
+    CHECK(getPoolBudget(cold, &budget));
+    ASSERT_EQUALS_INT(12, (int) budget.totalFrames, "pools shrunk to the new budget");
+    ASSERT_TRUE(cold->numPages >= budget.minFrames, "cold pool kept its minimum");
+
+    CHECK(setMemoryBudget(0));
+    CHECK(shutdownBufferPool(cold));
+    CHECK(shutdownBufferPool(hot));
+    CHECK(destroyPageFile(TESTPF));
+    CHECK(destroyPageFile(TESTPF2));
+
+    free(h);
+    free(cold);
+    free(hot);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testSnapshotWriteback (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    SM_FileHandle fh;
+    SM_PageHandle data = malloc(PAGE_SIZE);
+    OptimisticArgs args;
+    pthread_t writer;
+    int i, round, flushes = 0;
+
+    testName = "checkpoints write snapshots while a hot page keeps changing";
+
+    createPagedFile(4);
+    CHECK(initBufferPool(bm, TESTPF, 4, RS_LRU, NULL));
+    CHECK(pinPage(bm, h, 0));
+    CHECK(unpinPage(bm, h));
+
+    // each checkpoint runs while the writer rewrites page 0 for the next round; the
+    // test only hands rounds over, the page itself is shared through the buffer manager
+    args.bm = bm;
+    args.requested = 0;
+    args.completed = 0;
+    pthread_create(&writer, NULL, optimisticWriter, &args);
+    for (round = 1; round <= OPTIMISTIC_ROUNDS; round++)
+    {
+        __atomic_store_n(&args.requested, round, __ATOMIC_RELEASE);
+        CHECK(forceFlushPool(bm));
+        flushes++;
+        runOptimisticWriter(&args, round);
+    }
+    __atomic_store_n(&args.requested, -1, __ATOMIC_RELEASE);
+    pthread_join(writer, NULL);
+    ASSERT_EQUALS_INT(OPTIMISTIC_ROUNDS, flushes, "checkpoints ran alongside the writer");
+
+    // the last change survives, whatever the checkpoints saw
+    CHECK(forceFlushPool(bm));
+    CHECK(shutdownBufferPool(bm));
+    CHECK(openPageFile(TESTPF, &fh));
+    CHECK(readBlock(0, &fh, data));
+    CHECK(closePageFile(&fh));
+    for (i = 0; i < PAGE_SIZE && data[i] == 'a' + OPTIMISTIC_ROUNDS % 26; i++)
+        ;
+    ASSERT_EQUALS_INT(PAGE_SIZE, i, "final page contents reached the file");
+    CHECK(destroyPageFile(TESTPF));
+
+    free(data);
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testAdmissionFilter (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolStats stats;
+    int i, j, hot, rejects;
+
+    testName = "admission filter keeps the hot set out of a scan's way";
+
+    createPagedFile(64);
+    CHECK(initBufferPool(bm, TESTPF, 4, RS_LRU, NULL));
+    CHECK(setAdmissionFilter(bm, TRUE));
+
+    // four hot pages, each used a few times
+    for (j = 0; j < 4; j++)
+        for (i = 0; i < 4; i++)
+        {
+            CHECK(pinPage(bm, h, i));
+            CHECK(unpinPage(bm, h));
+        }
+
+    // a scan of pages used once is refused and served from one transient frame
+    for (i = 10; i < 20; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        ASSERT_EQUALS_INT(i, h->pageNum, "refused page still pinned");
+        CHECK(unpinPage(bm, h));
+    }
+    hot = 0;
+    for (i = 0; i < 4; i++)
+        if (isResident(bm, i))
+            hot++;
+    ASSERT_EQUALS_INT(3, hot, "scan took only one frame from the hot set");
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(10, (int) stats.admissionRejects, "every scan page refused");
+
+    // a page that keeps coming back is admitted once it is used more than a victim
+    for (i = 0; i < 5; i++)
+    {
+        CHECK(pinPage(bm, h, 40));
+        CHECK(unpinPage(bm, h));
+        CHECK(pinPage(bm, h, 50 + i));
+        CHECK(unpinPage(bm, h));
+    }
+    ASSERT_TRUE(isResident(bm, 40), "frequent page admitted");
+
+    // turned off, misses evict by plain LRU again
+    CHECK(getPoolStats(bm, &stats));
+    rejects = (int) stats.admissionRejects;
+    CHECK(setAdmissionFilter(bm, FALSE));
+    CHECK(pinPage(bm, h, 60));
+    CHECK(unpinPage(bm, h));
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(rejects, (int) stats.admissionRejects, "no refusals without the filter");
+    ASSERT_TRUE(isResident(bm, 60), "miss cached without the filter");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile(TESTPF));
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testFreeFrameList (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolStats stats;
+    int *fixCounts;
+    int i, writes, calls;
+
+    testName = "misses take free frames evicted in batches";
+
+    createPagedFile(128);
+    CHECK(initBufferPool(bm, TESTPF, 64, RS_LRU, NULL));
+
+    // fill all but the low-water mark of frames with dirty pages, without any eviction
+    for (i = 0; i < 62; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        sprintf(h->data, "Page-%i", i);
+        CHECK(unpinPageDirty(bm, h));
+    }
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(0, (int) stats.freeListRefills, "no refill while enough frames are free");
+    ASSERT_EQUALS_INT(2, stats.freeFrames, "unused frames are free");
+    writes = getNumWriteIO(bm);
+    calls = (int) stats.writeCalls;
+
+    // dropping below the mark evicts the four coldest pages and writes them with one call
+    CHECK(pinPage(bm, h, 62));
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 63));
+    CHECK(unpinPage(bm, h));
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(1, (int) stats.freeListRefills, "one batch evicted");
+    ASSERT_EQUALS_INT(4, stats.freeFrames, "rest of the batch kept free");
+    ASSERT_EQUALS_INT(writes + 4, getNumWriteIO(bm), "dirty victims written back");
+    ASSERT_EQUALS_INT(calls + 1, (int) stats.writeCalls, "in a single write");
+    for (i = 0; i < 4; i++)
+        ASSERT_TRUE(!isResident(bm, i), "coldest pages evicted");
+    ASSERT_TRUE(isResident(bm, 4), "next page kept");
+    fixCounts = getFixCounts(bm);
+    for (i = 0; i < 64; i++)
+        ASSERT_EQUALS_INT(0, fixCounts[i], "free frames are not pinned");
+    free(fixCounts);
+
+    // the next misses just take free frames, until the low-water mark asks for more
+    for (i = 64; i < 67; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(1, (int) stats.freeListRefills, "no eviction while frames are free");
+    ASSERT_EQUALS_INT(1, stats.freeFrames, "free frames used down to the low-water mark");
+    CHECK(pinPage(bm, h, 67));
+    CHECK(unpinPage(bm, h));
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(2, (int) stats.freeListRefills, "refilled below the low-water mark");
+    ASSERT_EQUALS_INT(4, stats.freeFrames, "a whole batch added");
+
+    // evicted pages come back with what was written
+    CHECK(pinPage(bm, h, 0));
+    ASSERT_EQUALS_STRING("Page-0", h->data, "batch write reached the file");
+    CHECK(unpinPage(bm, h));
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile(TESTPF));
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void *
+exclusiveWriter (void *arg)
+{
+    LatchArgs *args = (LatchArgs *) arg;
+    BM_PageHandle h;
+
+    if (pinPageExclusive(args->bm, &h, args->pageNum) != RC_OK)
+        return NULL;
+    sprintf(h.data, "written");
+    __atomic_store_n(&args->done, 1, __ATOMIC_SEQ_CST);
+    unpinPageDirty(args->bm, &h);
+    return NULL;
+}
+
+void
+testPageLatches (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *r1 = MAKE_PAGE_HANDLE();
+    BM_PageHandle *r2 = MAKE_PAGE_HANDLE();
+    BM_PoolStats stats;
+    LatchArgs args;
+    pthread_t writer;
+    int *fixCounts;
+
+    testName = "shared and exclusive page latches";
+
+    createPagedFile(4);
+    CHECK(initBufferPool(bm, TESTPF, 4, RS_LRU, NULL));
+
+    // readers share the latch
+    CHECK(pinPageShared(bm, r1, 1));
+    CHECK(pinPageShared(bm, r2, 1));
+    ASSERT_TRUE(r1->data == r2->data, "both readers see the same frame");
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(0, (int) stats.latchWaits, "readers do not wait for each other");
+
+    // a writer waits until the last reader leaves
+    args.bm = bm;
+    args.pageNum = 1;
+    args.done = 0;
+    pthread_create(&writer, NULL, exclusiveWriter, &args);
+    usleep(50 * 1000);
+    ASSERT_EQUALS_INT(0, __atomic_load_n(&args.done, __ATOMIC_SEQ_CST), "writer held off by readers");
+    CHECK(unpinPage(bm, r1));
+    usleep(20 * 1000);
+    ASSERT_EQUALS_INT(0, __atomic_load_n(&args.done, __ATOMIC_SEQ_CST), "writer held off by the last reader");
+    CHECK(unpinPage(bm, r2));
+    pthread_join(writer, NULL);
+    ASSERT_EQUALS_INT(1, args.done, "writer got the latch");
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(1, (int) stats.latchWaits, "one latch wait");
+
+    CHECK(pinPageShared(bm, r1, 1));
+    ASSERT_EQUALS_STRING("written", r1->data, "reader sees the write");
+    ASSERT_TRUE(latchPage(bm, r1, BM_LATCH_SHARED) != RC_OK, "latched handle cannot latch again");
+    CHECK(unpinPage(bm, r1));
+
+    // a plain pin can be latched afterwards; every latch is gone after the unpins
+    CHECK(pinPage(bm, r1, 2));
+    CHECK(latchPage(bm, r1, BM_LATCH_EXCLUSIVE));
+    CHECK(unpinPage(bm, r1));
+    CHECK(pinPageExclusive(bm, r1, 1));
+    CHECK(unpinPage(bm, r1));
+    CHECK(pinPageExclusive(bm, r1, 2));
+    CHECK(unpinPage(bm, r1));
+    fixCounts = getFixCounts(bm);
+    ASSERT_EQUALS_INT(0, fixCounts[0] + fixCounts[1] + fixCounts[2] + fixCounts[3], "no pins left");
+    free(fixCounts);
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(1, (int) stats.latchWaits, "free latches taken at once");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile(TESTPF));
+    free(r1);
+    free(r2);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testPinHints (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    RC rc;
+    int i;
+
+    testName = "pin hints keep or expedite pages in victim selection";
+
+    createPagedFile(64);
+    CHECK(initBufferPool(bm, TESTPF, 4, RS_LRU, NULL));
+
+    // a KEEP page outlives a run of misses that would otherwise age it out
+    CHECK(pinPageHint(bm, h, 0, BM_HINT_KEEP));
+    CHECK(unpinPage(bm, h));
+    for (i = 1; i <= 10; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        CHECK(unpinPage(bm, h));
+    }
+    ASSERT_TRUE(isResident(bm, 0), "kept page survives");
+    ASSERT_TRUE(isResident(bm, 9), "recent page resident");
+
+    // an EVICT_SOON page goes first, ahead of older pages
+    CHECK(pinPageHint(bm, h, 20, BM_HINT_EVICT_SOON));
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 30));
+    CHECK(unpinPage(bm, h));
+    ASSERT_TRUE(!isResident(bm, 20), "evict-soon page is the victim");
+    ASSERT_TRUE(isResident(bm, 9), "older page spared");
+    ASSERT_TRUE(isResident(bm, 0), "kept page still resident");
+
+    // pinning it again without a hint takes the hint back
+    CHECK(pinPageHint(bm, h, 31, BM_HINT_EVICT_SOON));
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 31));
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 32));
+    CHECK(unpinPage(bm, h));
+    ASSERT_TRUE(isResident(bm, 31), "re-pinned page no longer expedited");
+    ASSERT_TRUE(!isResident(bm, 10), "least recent page evicted instead");
+
+    // when every frame is kept, a miss still finds a victim
+    for (i = 40; i < 43; i++)
+    {
+        CHECK(pinPageHint(bm, h, i, BM_HINT_KEEP));
+        CHECK(unpinPage(bm, h));
+    }
+    CHECK(pinPage(bm, h, 43));
+    CHECK(unpinPage(bm, h));
+    ASSERT_TRUE(isResident(bm, 43), "miss served with only kept pages");
+    ASSERT_TRUE(!isResident(bm, 0), "least recent kept page evicted");
+
+    // a page can be hinted while pinned, e.g. once a scan has moved past it
+    CHECK(pinPage(bm, h, 41));
+    CHECK(setPageHint(bm, h, BM_HINT_EVICT_SOON));
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPage(bm, h, 44));
+    CHECK(unpinPage(bm, h));
+    ASSERT_TRUE(!isResident(bm, 41), "page hinted while pinned is the victim");
+    ASSERT_TRUE(isResident(bm, 40), "kept page spared");
+
+    rc = pinPageHint(bm, h, 1, (BM_PinHint) 7);
+    ASSERT_EQUALS_INT(RC_ERR, rc, "unknown hint refused");
+    rc = setPageHint(bm, h, BM_HINT_KEEP);
+    ASSERT_EQUALS_INT(RC_PAGE_NOT_FOUND, rc, "unpinned handle cannot be hinted");
+
+    CHECK(shutdownBufferPool(bm));
+    CHECK(destroyPageFile(TESTPF));
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testNewPages (void)
+{
+    BM_BufferPool *bm = MAKE_POOL();
+    BM_PageHandle *h = MAKE_PAGE_HANDLE();
+    BM_PoolStats stats;
+    SM_FileHandle fh;
+    SM_PageHandle ph = (SM_PageHandle) malloc(PAGE_SIZE);
+    char *zero = calloc(PAGE_SIZE, 1);
+    char expected[32];
+    int i;
+
+    testName = "new pages are zeroed in memory and written without a read";
+
+    createPagedFile(2);
+    CHECK(initBufferPool(bm, TESTPF, 3, RS_LRU, NULL));
+
+    // leave old contents in the frames
+    for (i = 0; i < 2; i++)
+    {
+        CHECK(pinPage(bm, h, i));
+        sprintf(h->data, "old-%i", i);
+        CHECK(unpinPageDirty(bm, h));
+    }
+
+    // new pages follow the file, start zeroed and dirty, and are written back on eviction
+    for (i = 2; i < 8; i++)
+    {
+        CHECK(pinNewPage(bm, h));
+        ASSERT_EQUALS_INT(i, h->pageNum, "next page allocated");
+        ASSERT_TRUE(memcmp(h->data, zero, PAGE_SIZE) == 0, "new page zeroed");
+        if (i == 2)
+            ASSERT_EQUALS_INT(2, ((SM_FileHandle *) bm->mgmtData)->totalNumPages, "file grows only on writeback");
+        sprintf(h->data, "new-%i", i);
+        CHECK(unpinPage(bm, h));
+    }
+
+    // the latched variant holds the exclusive latch from the moment the page exists
+    CHECK(pinNewPageExclusive(bm, h));
+    ASSERT_EQUALS_INT(8, h->pageNum, "latched new page allocated");
+    ASSERT_EQUALS_INT(BM_LATCH_EXCLUSIVE, h->latchMode, "new page latched exclusively");
+    sprintf(h->data, "new-%i", 8);
+    CHECK(unpinPage(bm, h));
+    CHECK(pinPageExclusive(bm, h, 8));
+    CHECK(unpinPage(bm, h));
+
+    ASSERT_EQUALS_INT(9, getNumFilePages(bm), "new pages counted");
+    CHECK(getPoolStats(bm, &stats));
+    ASSERT_EQUALS_INT(2, (int) stats.readIO, "no reads for new pages");
+    ASSERT_EQUALS_INT(7, (int) stats.newPages, "new pages reported");
+    CHECK(shutdownBufferPool(bm));
+
+    CHECK(openPageFile(TESTPF, &fh));
+    ASSERT_EQUALS_INT(9, fh.totalNumPages, "file grown to the new pages");
+    for (i = 2; i < 9; i++)
+    {
+        CHECK(readBlock(i, &fh, ph));
+        sprintf(expected, "new-%i", i);
+        ASSERT_EQUALS_STRING(expected, ph, "new page written back");
+    }
+    CHECK(closePageFile(&fh));
+
+    CHECK(destroyPageFile(TESTPF));
+    free(ph);
+    free(zero);
+    free(h);
+    free(bm);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testSketchResize (void)
+{
+    Frequency_sketch *sketch = createFrequencySketch(4);
+    int file, count, i;
+
+    testName = "admission sketch keeps its counts across pool resizes";
+
+    for (i = 0; i < 5; i++)
+        sketchIncrement(sketch, &file, 7);
+
+    // grown for a large pool: counts carry over and aging follows the new size
+    ASSERT_TRUE(resizeFrequencySketch(sketch, 1000), "sketch grown");
+    count = sketchEstimate(sketch, &file, 7);
+    ASSERT_EQUALS_INT(5, count, "count kept when growing");
+    for (i = 100; i < 600; i++)
+        sketchIncrement(sketch, &file, i);
+    count = sketchEstimate(sketch, &file, 7);
+    ASSERT_TRUE(count >= 5, "no aging after a few hundred pins of a large pool");
+
+    // shrunk again: merged counters keep the larger count
+    ASSERT_TRUE(resizeFrequencySketch(sketch, 4), "sketch shrunk");
+    count = sketchEstimate(sketch, &file, 7);
+    ASSERT_TRUE(count >= 5, "count kept when shrinking");
+
+    destroyFrequencySketch(sketch);
+    TEST_DONE();
+}
+
+// ************************************************************
+void
+testConcurrentInit (void)
+{
+    pthread_t threads[INIT_THREADS];
+    InitArgs args[INIT_THREADS];
+    int i, sharing = 0;
+
+    testName = "pools opened on one file at the same time share one cache";
+
+    createPagedFile(4);
+    for (i = 0; i < INIT_THREADS; i++)
+        pthread_create(&threads[i], NULL, initWorker, &args[i]);
+    for (i = 0; i < INIT_THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+        CHECK(args[i].status);
+    }
+
+    // pools on one file share its handle, so all of them see one copy of every page
+    for (i = 0; i < INIT_THREADS; i++)
+        if (args[i].bm.mgmtData == args[0].bm.mgmtData)
+            sharing++;
+    ASSERT_EQUALS_INT(INIT_THREADS, sharing, "every pool shares the first one's cache");
+
+    for (i = 0; i < INIT_THREADS; i++)
+        CHECK(shutdownBufferPool(&args[i].bm));
+    CHECK(destroyPageFile(TESTPF));
+    TEST_DONE();
+}
+
+void *
+initWorker (void *arg)
+{
+    InitArgs *args = (InitArgs *) arg;
+    args->status = initBufferPool(&args->bm, TESTPF, 3, RS_LRU, NULL);
+    return NULL;
+}